@@ -6,74 +6,135 @@
 #include <avr/io.h>
 #include <avr/interrupt.h>
 #include <avr/pgmspace.h>
+#include <util/atomic.h>
 #include "SerialAccelerometer.h"
 #include "adc.h"
 #include "uart.h"
 #include "timer2.h"
+#include "timer1.h"
 #include "eeprom.h"
+#include "frame.h"
+#include "delta.h"
+#include "throughput.h"
+#include "command.h"
+#include "filter.h"
+#include "trigger.h"
+
+//The self test and the factory settings use 38400 baud, so a clock that can't make it would leave the board unreachable
+#if (UART_ERROR_NORMAL(38400) > UART_MAX_BAUD_ERROR) && (UART_ERROR_U2X(38400) > UART_MAX_BAUD_ERROR)
+#error F_CPU is too slow or too odd for the factory default baud rate of 38400
+#endif
+
+//The largest burst frame has to fit in the UART transmit buffer, or it could never be sent
+#if (DELTA_MAX_PAYLOAD(MAX_BURST_SIZE, 3) + FRAME_OVERHEAD) >= UART_TX_BUFFER_SIZE
+#error UART_TX_BUFFER_SIZE is too small for MAX_BURST_SIZE
+#endif
+//Event frames wait for room in the transmit buffer, so the largest one has to fit too
+#if (TRIGGER_MAX_PAYLOAD(3) + FRAME_OVERHEAD) >= UART_TX_BUFFER_SIZE
+#error UART_TX_BUFFER_SIZE is too small for TRIGGER_FRAME_SAMPLES
+#endif
 
 //================================================================
 //Define Global Variables
 //================================================================
 char tempCharacter=0;
 char firstRun=0;
-volatile unsigned int currentAxis = Z_AXIS, currentReading=0;
-//ADC Reading array will hold the last NUM_READINGS adc values for each axis.
-volatile unsigned int adcReading[3][NUM_READINGS];
+//The order the ADC scheduler converts the axis in, and the order they are output in. Axis that aren't
+//enabled in the axisMask setting are left out. A sample is complete once the last enabled axis is in.
+const unsigned char axisScanOrder[3] = {X_AXIS, Y_AXIS, Z_AXIS};
+unsigned char sampleLastAxis = Z_AXIS;
+//Completed samples are handed from the ADC interrupt to the main loop through this ring.
+//The interrupt fills the slot at sampleHead and publishes it by incrementing sampleHead once all 3 axis are in.
+//The main loop reads from sampleTail (see getSample). Neither side ever has to stop the ADC or disable interrupts.
+volatile struct adcSample sampleBuffer[SAMPLE_BUFFER_SIZE];
+volatile unsigned char sampleHead=0;
+unsigned char sampleTail=0;
+//Counters shown by the diagnostics menu and sent in status frames
+volatile struct performanceCounters performance;
+//Running average state kept by the ADC interrupt. adcSum holds the total of the last (averageMask+1) readings
+//of each axis, and adcHistory holds those readings so the oldest can be subtracted when a new one arrives.
+volatile unsigned int adcHistory[3][MAX_AVERAGE_WINDOW];
+volatile unsigned int adcSum[3];
+volatile unsigned char historyIndex=0, averageMask=0;
 volatile bool blinkOn = false;
+//The CIC or IIR filter the samples go through in measurement mode when the filter setting isn't FILTER_AVERAGE.
+//It is a global rather than a local of main so its size shows up in .bss.
+struct filterState sampleFilter;
+//The history and state of the triggered capture, used instead of the output mode when the trigger mode isn't TRIGGER_OFF.
+//The size of its history is set by TRIGGER_BUFFER_SIZE.
+struct triggerCapture eventCapture;
 
 //This is a list of the possible baud rates, chosen by the baudRate setting
-const unsigned long baudRateSettings[7] = {4800, 9600, 14400, 19200, 38400, 57600, 115200};
-//This is a list of the output frequency limits, which are based on the output mode and baud rate.
-//Limits were found by experimental testing, and are limited to 250 Hz to ensure that all 3 axis are read
-// before displaying the values.
-//There is a seperate list of limits for each output mode, and each list contains a limit for every possible baud rate.
-//TODO: Make this be a calculation instead of a list.
-const unsigned long outputFrequencyLimits[3][7] = {
-{25, 45, 66, 83, 125, 142, 166},
-{27, 58, 76, 111, 200, 250, 250}, 
-{47, 90, 125, 166, 250, 250, 250}
-};
+//The last three have no error at 8 and 16 MHz, but uartInit will refuse them if F_CPU can't make them accurately (i.e. 1000000 at 20 MHz).
+const unsigned long baudRateSettings[NUM_BAUD_RATES] = {4800, 9600, 14400, 19200, 38400, 57600, 115200, 250000, 500000, 1000000};
+//The accelerometer ranges, indexed by RANGE_INDEX. Each range has its own calibration and swing values.
+const int rangeSettings[NUM_RANGES] = {RANGE_15, RANGE_60};
+//The output frequency limits are calculated from the baud rate, the frame size of the output mode and the
+//ADC conversion rate (see throughputLimit). 'make limits' prints them next to the old measured limits.
 
 /**************************************************************
 * Define Interrupt Subroutines
 **************************************************************/
+//Description: Stores each ADC conversion and moves the ADC to the next axis.
+//Note: The ADC scheduler (see adcScanNext) keeps track of which axis each reading belongs to and sets up the
+// multiplexer for the conversions after it, including the readings thrown away after a channel switch.
 ISR(ADC_vect)
 {
-	cli();
+	unsigned int start = TCNT1, end;
+	volatile struct adcSample* sample = &sampleBuffer[sampleHead & SAMPLE_BUFFER_MASK];
+	unsigned char axis, channel, index = historyIndex;
+	unsigned int reading;
+	
+	performance.adcConversions++;
 	//Get the value from the ADC
-	adcReading[currentAxis][currentReading%NUM_READINGS]=ADCL;				//Get the lowest 8 bits of the 10 bit conversion
-	adcReading[currentAxis][currentReading%NUM_READINGS] |= (ADCH << 8);	//Get the upper 2 bits of the 10 bit conversion
-
-	//Update the axis (Read each axis before updating the currentReading parameter.)
-	if(currentAxis == Z_AXIS)
-	{
-		currentAxis = X_AXIS;
-		currentReading++;
-	}
-	else currentAxis--;
+	reading = ADCL;				//Get the lowest 8 bits of the 10 bit conversion
+	reading |= (ADCH << 8);	//Get the upper 2 bits of the 10 bit conversion
+	//Clear the timer 1 compare flag so the next compare match can trigger the next conversion
+	TIFR1 = (1<<OCF1B);
 	
-	//Update the ADC Channel to get the value of the next axis
-    ADMUX = (ADMUX & 0xF0);	//Mask OFF the previous ADC channel
-	ADMUX |= (currentAxis & 0x0F);		//Set the new ADC channel	
+	//Find out which axis this reading belongs to, and set the ADC channel for the conversion after it
+	axis = adcScanNext(&channel);
+	ADMUX = (ADMUX & 0xF0) | channel;
+	if(axis != ADC_SCAN_DISCARD){
+		//Update the running total: drop the oldest reading in the window and add the new one
+		adcSum[axis] += reading - adcHistory[axis][index];
+		adcHistory[axis][index] = reading;
+		
+		sample->axis[axis] = reading;
+		sample->sum[axis] = adcSum[axis];
+		
+		//All of the enabled axis are in, hand the sample to the main loop
+		if(axis == sampleLastAxis)
+		{
+			historyIndex = (index + 1) & averageMask;
+			sampleHead++;
+		}
+	}
 	
-	sei();
+	//Timer 1 is the sample clock, so it may have passed TOP since the interrupt started
+	end = TCNT1;
+	if(end < start)end += OCR1A + 1;
+	performance.isrTicks += end - start;
 }
 
-//Description: Timer 2 overflow interrupt keeps track of elapsed milliseconds
-//Note: timer 2 can't be used by anything else now!
-// Also, this ISR assumes an 8 MHz F_CPU
-//TODO: Move this to another interrupt vector so that timer 2 can be shared.
-ISR(TIMER2_OVF_vect)
+//Description: Timer 2 compare match A interrupt keeps track of elapsed milliseconds (see timer2Init)
+//Note: Interrupts are already off inside the ISR, and the timer restarts its count by itself,
+// so all that is left to do is count.
+ISR(TIMER2_COMPA_vect)
 {
-	cli();
+	static unsigned char blinkCount=0;
+	unsigned int start = TCNT1, end;
 	
-	elapsedMillis++;	//Increment the millisecond timer
-	TCNT2 = 5;
+	timer2Tick();	//Increment the millisecond timer
 	
-	if(blinkOn && (elapsedMillis % 100==0))ledToggle();
+	if(blinkOn && (++blinkCount >= 100)){
+		blinkCount = 0;
+		ledToggle();
+	}
 	
-	sei();
+	end = TCNT1;
+	if(end < start)end += OCR1A + 1;
+	performance.isrTicks += end - start;
 }
 
 int main (void)
@@ -83,24 +144,67 @@ int main (void)
 	**************************************************************/
 	//Create structures that will hold the ADC counts of the MMA7361 axis measurements
 	struct sensorReadings sensorADCCount;
-	//Create a structure for the sensor voltages (stored in millivolts)
-	struct sensorReadings sensorVoltage;
-	//Create a structure that will hold the calibration values, aka 0g offset values (stored in millivolts)
-	struct sensorReadings sensorCalibration;
-	//Create a structure that will hold the millivolt 'swing' for each axis (i.e. number of millivolts that represent 1g to -1g)
+	//Create a structure for each accelerometer range that will hold the calibration values, aka 0g offset values (stored in millivolts)
+	struct sensorReadings sensorCalibration[NUM_RANGES];
+	//Create a structure for each range that will hold the millivolt 'swing' for each axis (i.e. number of millivolts that represent 1g to -1g)
 	//(used for calculating the G Value)
-	struct sensorReadings sensorSwing;
-	//Create a structure that will hold the g value data for the MMA7361 data (X, Y and Z axis)
-	struct sensorValues sensorG;
+	struct sensorReadings sensorSwing[NUM_RANGES];
+	//The range in use (RANGE_INDEX of the accelerometerRange setting)
+	unsigned char activeRange=RANGE_INDEX_15, range;
+	//Create a structure that will hold the fixed point count to g conversion factors for each axis
+	struct gravityConversion sensorGravity;
+	//The Q16 gravity factors of each range and axis, indexed by ADC channel (X_AXIS, Y_AXIS and Z_AXIS).
+	//Both ranges are worked out before measurement mode starts, so switching range doesn't hold up the samples.
+	unsigned long axisScale[NUM_RANGES][3], axisOffset[NUM_RANGES][3];
+	//Samples still to be thrown away after a range switch, and whether the burst in framePayload is ready to go
+	unsigned int rangeSettle=0;
+	bool burstReady=false;
+	//Holds the g values (in hundredths of a g) for the self test
+	int testX=0, testY=0, testZ=0;
 	//Create a structure to hold the configuration settings.
 	struct settings mySettings;
+	//Holds the latest sample from the ADC interrupt, and the running total of the samples in the current output frame
+	struct adcSample newSample;
+	unsigned int samplesInFrame=0;
+	//Set when the samples go through sampleFilter instead of the ADC interrupt's running average
+	bool filtered=false;
+	unsigned int filterCutoff;
+	//Set when eventCapture is used instead of the output mode (the trigger mode isn't TRIGGER_OFF)
+	bool triggered=false;
+	int axisG[3];
+	//The enabled axis (in axisScanOrder), and the output value of each one for the current frame
+	unsigned char axisChannel[3], axisCount=3, slot;
+	unsigned int axisValue[3];
+	//Frame types carry the axis mask in their high nibble when some axis are left out (see FRAME_AXES_SHIFT)
+	unsigned char frameAxes=0;
+	//The number of samples in each output frame is 2^windowShift. The window sum is shifted right by valueShift
+	//to get the output value (less than windowShift when oversampling, which leaves the extra bits of resolution).
+	//The output values are 2^extraBits times larger than ADC counts.
+	char windowShift=0, valueShift=0, extraBits=0;
+	//Sequence number and payload for the framed binary output modes. The payload is big enough for the largest burst
+	//(a delta compressed burst can be one byte bigger than an uncompressed one if nothing compresses) and the largest event frame.
+	unsigned int frameSequence=0;
+	unsigned char framePayload[(DELTA_MAX_PAYLOAD(MAX_BURST_SIZE, 3) > TRIGGER_MAX_PAYLOAD(3)) ? DELTA_MAX_PAYLOAD(MAX_BURST_SIZE, 3) : TRIGGER_MAX_PAYLOAD(3)];
+	unsigned char samplesInBurst=0;
+	struct deltaEncoder compressor;
+	//Status frames have their own payload so they can be sent in the middle of a burst
+	unsigned char statusFrame[STATUS_PAYLOAD_SIZE];
+	//Timer 2 tick count at the start of the current main loop pass, for the performance counters
+	unsigned int loopStart=0, loopTicks;
+	//Binary commands (see command.h). Setting changes are made to commandSettings first, so measurement mode can finish what it
+	//is doing with the old settings before they change, and the reply waits in replyFrame until then.
+	struct commandParser commandIn;
+	struct settings commandSettings;
+	unsigned char replyFrame[REPLY_PAYLOAD_SIZE], replyLength=0, commandActions;
+	//After a command the menu isn't shown again until some other key arrives
+	bool menuQuiet=false;
+	//Set when measurement mode has to set up the sampling (when it starts, and when a command changes the settings)
+	bool streamSetup=false;
 
 	//Run program will keep the device in a 'measurement mode.'
 	bool runProgram = false;
 	//This variable will hold the current menu selection entered by the user.
 	char menuSelection = 0;
-	//This variable will hold the maximum output period (converted from frequency) for the current output mode/baud rate combination
-	unsigned long outputPeriod = 0, currentTime=0;
 	
 	//Testing Variable
 	int testValue=1;
@@ -125,19 +229,27 @@ int main (void)
 		mySettings.outputMode = OUTPUT_GRAVITY;
 		mySettings.outputFrequency = 50;
 		mySettings.baudRate = BAUD_38400;
+		mySettings.averageShift = DEFAULT_AVERAGE_SHIFT;
+		mySettings.extraResolution = 0;
+		mySettings.burstSize = DEFAULT_BURST_SIZE;
+		mySettings.adcClock = ADC_CLOCK_STANDARD;
+		mySettings.adcDiscard = 0;
+		mySettings.axisMask = AXIS_MASK_ALL;
+		mySettings.filter = FILTER_AVERAGE;
+		mySettings.filterShift = DEFAULT_FILTER_SHIFT;
+		mySettings.filterCutoff = DEFAULT_FILTER_CUTOFF;
+		mySettings.triggerMode = TRIGGER_OFF;
+		mySettings.triggerThreshold = DEFAULT_TRIGGER_THRESHOLD;
+		mySettings.triggerPre = DEFAULT_TRIGGER_PRE;
+		mySettings.triggerPost = DEFAULT_TRIGGER_POST;
 		saveSettings(&mySettings);
 		
-		//Set the calibration values to the MMA7361 recomended values
-		sensorCalibration.x=1650;
-		sensorCalibration.y=1650;
-		sensorCalibration.z=1650;
-		saveCalibration(&sensorCalibration);
-		
-		//Set the swing values for each axis to the estimated values in 1.5g mode from the MMA7361 datasheet
-		sensorSwing.x = RANGE_15;
-		sensorSwing.y = RANGE_15;
-		sensorSwing.z = RANGE_15;
-		saveSwing(&sensorSwing);
+		//Set the calibration and swing values of both ranges to the MMA7361 recomended values
+		for(range=0; range < NUM_RANGES; range++){
+			defaultCalibration(range, &sensorCalibration[range], &sensorSwing[range]);
+			saveCalibration(range, &sensorCalibration[range]);
+			saveSwing(range, &sensorSwing[range]);
+		}
 		
 		//Write a 0 to the first run memory location.
 		eepromWriteChar(0, 0);
@@ -147,7 +259,7 @@ int main (void)
 		uartInit(38400);
 		sei();
 		
-		printf("Testing Accelerometer...\n\r");
+		printf_P(PSTR("Testing Accelerometer...\n\r"));
 		delayMs(1000);
 		
 		//Read each axis of the accelerometer
@@ -155,29 +267,28 @@ int main (void)
 		sensorADCCount.y = adcRead(Y_AXIS);
 		sensorADCCount.z = adcRead(Z_AXIS);	
 
-		//Convert the values to Voltages
-		toVoltage(sensorADCCount.x, sensorVoltage.x);
-		toVoltage(sensorADCCount.y, sensorVoltage.y);
-		toVoltage(sensorADCCount.z, sensorVoltage.z);				
-		//Finally convert the voltages to Gs
-		toGValue(&sensorG, &sensorVoltage, &sensorCalibration, &sensorSwing);	
+		//Convert the counts to Gs (in hundredths of a g)
+		computeGravityScale(&sensorGravity, &sensorCalibration[RANGE_INDEX_15], &sensorSwing[RANGE_INDEX_15], 0);
+		testX = countToCentiG(sensorADCCount.x, sensorGravity.scale.x, sensorGravity.offset.x);
+		testY = countToCentiG(sensorADCCount.y, sensorGravity.scale.y, sensorGravity.offset.y);
+		testZ = countToCentiG(sensorADCCount.z, sensorGravity.scale.z, sensorGravity.offset.z);
 		
 		//Now check to see if the sensor values are within range
 		//Check X Axis
-		if((sensorG.x >= 0.2) || (sensorG.x <= -0.2)){
-			printf("X Axis Fails!\n\r");
+		if((testX >= 20) || (testX <= -20)){
+			printf_P(PSTR("X Axis Fails!\n\r"));
 			testValue=0;
 		}
-		if((sensorG.y >= 0.2) || (sensorG.y <= -0.2)){
-			printf("Y Axis Fails!\n\r");
+		if((testY >= 20) || (testY <= -20)){
+			printf_P(PSTR("Y Axis Fails!\n\r"));
 			testValue=0;
 		}		
-		if((sensorG.z >= 1.2) || (sensorG.z <= 0.8)){
-			printf("Z Axis Fails!\n\r");
+		if((testZ >= 120) || (testZ <= 80)){
+			printf_P(PSTR("Z Axis Fails!\n\r"));
 			testValue=0;
 		}	
 		if(testValue == 1){
-			printf("Pass\n\r");
+			printf_P(PSTR("Pass\n\r"));
 			blinkOn = false;
 			ledOn();
 		}
@@ -187,13 +298,14 @@ int main (void)
 	//Otherwise, load settings from EEPROM
 	else{
 		loadSettings(&mySettings);
-		loadCalibration(&sensorCalibration);
-		loadSwing(&sensorSwing);
+		loadRangeCalibration(&mySettings, sensorCalibration, sensorSwing);
 	}
 	
 	//Use the settings to configure the device 	
 	uartInit(baudRateSettings[mySettings.baudRate]);
 	setAccelerometerRange(mySettings.accelerometerRange);
+	activeRange = RANGE_INDEX(mySettings.accelerometerRange);
+	commandReset(&commandIn);
 	
 	/***************************************************************
 	* Run the main code
@@ -208,136 +320,378 @@ int main (void)
 		* is chosen.
 		************************************************************************/
 		ledOn();
-		//Take the ADC Module out of free running mode
-		adcFreeRunning(0);
+		//Stop the sample clock and the ADC scheduler, and go back to the accurate ADC clock for the menus
+		adcScanStop();
+		timer1Stop();
+		adcSetClock(ADC_CLOCK_STANDARD);
 		//Make sure the program is not in run mode (unless set in the menu)
 		runProgram = false;
-		//Keep displaying the configuration menu until a valid option is selected
-		menuSelection = configMenu(&mySettings, &sensorCalibration);
-		while(((menuSelection < '1') || (menuSelection > '5')) && (toupper(menuSelection) != 'X')) {
-			printf("Invalid Selection!\n\r");
-			menuSelection = configMenu(&mySettings, &sensorCalibration);
+		//Binary commands (see command.h) can be sent in place of a menu selection. After one has been, the menu isn't shown
+		//again until some other key arrives (that key only brings the menu back), so a program that only sends commands
+		//never has to wait for the menu text.
+		if(menuQuiet)menuSelection = uartGetChar();
+		else menuSelection = configMenu(&mySettings, &sensorCalibration[activeRange]);
+		if(menuSelection == (char)FRAME_SYNC1){
+			menuQuiet = true;
+			if(receiveCommand(&commandIn, menuSelection)){
+				commandSettings = mySettings;
+				commandActions = runCommand(&commandIn, &commandSettings, false, replyFrame, &replyLength);
+				outputFrame(FRAME_TYPE_REPLY, frameSequence++, replyFrame, replyLength);
+				replyLength = 0;
+				//The reply goes out at the old baud rate (uartInit waits for it)
+				if(commandSettings.baudRate != mySettings.baudRate)uartInit(baudRateSettings[commandSettings.baudRate]);
+				mySettings = commandSettings;
+				if(commandActions & COMMAND_ACTION_RANGE){
+					setAccelerometerRange(mySettings.accelerometerRange);
+					activeRange = RANGE_INDEX(mySettings.accelerometerRange);
+				}
+				if(commandActions & COMMAND_ACTION_START)runProgram = true;
+			}
 		}
-		printf("%c\n\n\r", menuSelection);
-		switch(toupper(menuSelection)){
-			case MENU_CALIBRATE: 
-				//Lead the user through calibrating the sensor
-				//May also need to record the 1g 'swing' (or the actual millivolts per G) along with the 0g value
-				selectCalibrationValues(&sensorCalibration, &sensorSwing);
-				//Save the new calibration values
-				cli();
-				saveCalibration(&sensorCalibration);
-				saveSwing(&sensorSwing);
-				sei();
-				break;
-			case MENU_MODE:
-				//Prompt the user to select the desired output mode (G value, Raw Data, or Raw Data in Binary Format)
-				//Output mode will be used in Measurement mode to determine which format to output the data in
-				selectOutputMode(&mySettings);
-				break;
-			case MENU_FREQUENCY:
-				//Prompt the user to select the output frequency.
-				//User is limited to upper bounds based on output format and the current baud rate.
-				//This value will determine the ADC read frequencies as well as the output frequency.
-				selectOutputFrequency(&mySettings);
-				break;
-			case MENU_RANGE:
-				//Prompt the user to select the G range of the MMA7361 (+/-1.5G or +/-6.0g)
-				selectAccelerometerRange(&mySettings, &sensorSwing);
-				setAccelerometerRange(mySettings.accelerometerRange);
-				break;
-			case MENU_BAUD:
-				//Prompt the user for the new baud rate setting
-				selectBaudRate(&mySettings);
-				//Reinitialize the UART for the new baud rate
-				uartInit(baudRateSettings[mySettings.baudRate]);
-				break;
-			case MENU_EXIT:
-				//If the user exits the configuration menu, the device will enter measurement mode.
-				runProgram = true;
-				break;
+		else if(menuQuiet){
+			menuQuiet = false;
 		}
-		//Check to see if the new settings caused the current output frequency to exceed the maximum value
-		//If the maximum frequency has been exceeded, limit it and notify the user!
-		if(mySettings.outputFrequency > outputFrequencyLimits[mySettings.outputMode][mySettings.baudRate])
-		{
-			printf("The new settings have caused the output frequency to change.\n\n\r");
-			mySettings.outputFrequency = outputFrequencyLimits[mySettings.outputMode][mySettings.baudRate];
+		else{
+			//Keep displaying the configuration menu until a valid option is selected
+			while(((menuSelection < '1') || (menuSelection > MENU_DIAGNOSTICS)) && ((toupper(menuSelection) < MENU_ADC) || (toupper(menuSelection) > MENU_TRIGGER)) && (toupper(menuSelection) != 'X')) {
+				printf_P(PSTR("Invalid Selection!\n\r"));
+				menuSelection = configMenu(&mySettings, &sensorCalibration[activeRange]);
+			}
+			printf_P(PSTR("%c\n\n\r"), menuSelection);
+			switch(toupper(menuSelection)){
+				case MENU_CALIBRATE: 
+					//Lead the user through calibrating the sensor
+					//May also need to record the 1g 'swing' (or the actual millivolts per G) along with the 0g value
+					//Calibrates the range in use, the other range keeps its values
+					selectCalibrationValues(&sensorCalibration[activeRange], &sensorSwing[activeRange]);
+					//Save the new calibration values (queued, only the bytes that changed are written)
+					saveCalibration(activeRange, &sensorCalibration[activeRange]);
+					saveSwing(activeRange, &sensorSwing[activeRange]);
+					break;
+				case MENU_MODE:
+					//Prompt the user to select the desired output mode (G value, Raw Data, or Raw Data in Binary Format)
+					//Output mode will be used in Measurement mode to determine which format to output the data in
+					selectOutputMode(&mySettings);
+					break;
+				case MENU_FREQUENCY:
+					//Prompt the user to select the output frequency.
+					//User is limited to upper bounds based on output format and the current baud rate.
+					//This value will determine the ADC read frequencies as well as the output frequency.
+					selectOutputFrequency(&mySettings);
+					break;
+				case MENU_RANGE:
+					//Prompt the user to select the G range of the MMA7361 (+/-1.5G or +/-6.0g)
+					//Each range keeps its own calibration, so nothing has to be reset
+					selectAccelerometerRange(&mySettings);
+					setAccelerometerRange(mySettings.accelerometerRange);
+					activeRange = RANGE_INDEX(mySettings.accelerometerRange);
+					break;
+				case MENU_BAUD:
+					//Prompt the user for the new baud rate setting
+					selectBaudRate(&mySettings);
+					//Reinitialize the UART for the new baud rate
+					uartInit(baudRateSettings[mySettings.baudRate]);
+					break;
+				case MENU_AVERAGING:
+					//Prompt the user for the number of readings to average for each output value
+					selectAveraging(&mySettings);
+					break;
+				case MENU_RESOLUTION:
+					//Prompt the user for the output resolution (extra bits come from oversampling)
+					selectResolution(&mySettings);
+					break;
+				case MENU_BURST:
+					//Prompt the user for the number of samples in each burst frame
+					selectBurstSize(&mySettings);
+					break;
+				case MENU_ADC:
+					//Prompt the user for the ADC clock (sample rate against accuracy) and the channel switch discard
+					selectAdcClock(&mySettings);
+					break;
+				case MENU_AXES:
+					//Prompt the user for the axis to sample and output
+					selectAxes(&mySettings);
+					break;
+				case MENU_FILTER:
+					//Prompt the user for the filter that reduces the samples to the output frequency
+					selectFilter(&mySettings);
+					break;
+				case MENU_TRIGGER:
+					//Prompt the user for the trigger that starts a captured event
+					selectTrigger(&mySettings);
+					break;
+				case MENU_DIAGNOSTICS:
+					//Show the performance counters from the last measurement run
+					showDiagnostics();
+					break;
+				case MENU_EXIT:
+					//If the user exits the configuration menu, the device will enter measurement mode.
+					runProgram = true;
+					break;
+			}
+			//Check to see if the new settings caused the current output frequency to exceed the maximum value
+			//If the maximum frequency has been exceeded, limit it and notify the user!
+			if(mySettings.outputFrequency > maxOutputFrequency(&mySettings))
+			{
+				printf_P(PSTR("The new settings have caused the output frequency to change.\n\n\r"));
+				mySettings.outputFrequency = maxOutputFrequency(&mySettings);
+			}
+			//Always save the settings after exiting the configuration menu, just in case something changed.
+			//Only the bytes that changed are written, in the background by the EEPROM Ready interrupt.
+			saveSettings(&mySettings);
 		}
-		//Always save the settings after exiting the configuration menu, just in case something changed
-		cli();
-		saveSettings(&mySettings);
-		sei();	
 	
 		/**************************************************************
 		* Measurement Mode
 		* The device will stay in this mode until a key is pressed
 		**************************************************************/
 		if(runProgram){
-			//Set up the ADC to start reading from the X axis
-			currentAxis = X_AXIS;
-			currentReading = 0;
-			adcRead(currentAxis);	//Set the ADMUX Registers to read from the X Axis
-			//Put the ADC Module into free running mode
-			adcFreeRunning(1);
-			
-			//Figure out what the output period should be, given the output frequency
-			outputPeriod = 1000/mySettings.outputFrequency;	//Find the period in ms.
-			//Used for Debug Purposes
-			//printf("Output Peridod: %lu\n\r", outputPeriod);
-			//delayMs(1000);
-			
-			//Wait to get at least NUM_READINGS so we can average the readings properly
-			while(currentReading < NUM_READINGS);
+			//The counters describe this run, so let the menu text drain out of the transmit buffer first
+			uartFlush();
+			clearPerformanceCounters();
+			commandSettings = mySettings;
+			streamSetup = true;
 		}
-		
-		while(runProgram){	
-			//Clear out the last value
-			sensorADCCount.x=0;
-			sensorADCCount.y=0;
-			sensorADCCount.z=0;
-		
-			//Get the continuous average of the last NUM_READINGS adc readings for each axis
-			//Pause interrupts while we do this.
-			adcFreeRunning(0);
-			for(int readingNumber=0; readingNumber < NUM_READINGS; readingNumber++)
-			{
-				sensorADCCount.x += adcReading[X_AXIS][readingNumber];
-				sensorADCCount.y += adcReading[Y_AXIS][readingNumber];
-				sensorADCCount.z += adcReading[Z_AXIS][readingNumber];
+		while(runProgram){
+			//Send the burst frame once it is full, or early when the range or the settings have just been changed so a frame never mixes them
+			if(burstReady){
+				if(mySettings.outputMode == OUTPUT_PACKED){
+					//Packed values are always 10 bits, so any extra bits from oversampling are dropped
+					outputFrame(FRAME_TYPE_PACKED | frameAxes, frameSequence++, framePayload, packSamples(framePayload, samplesInBurst * axisCount, extraBits));
+				}
+				else if(mySettings.outputMode == OUTPUT_DELTA)outputFrame(FRAME_TYPE_DELTA | frameAxes, frameSequence++, framePayload, deltaFinish(&compressor));
+				else outputFrame(FRAME_TYPE_BURST | frameAxes, frameSequence++, framePayload, samplesInBurst * axisCount * 2);
+				//A full burst finishes the handling of the sample that filled it
+				if(samplesInBurst >= mySettings.burstSize){
+					loopTicks = timer2Ticks() - loopStart;
+					if(loopTicks > performance.maxLoopTicks)performance.maxLoopTicks = loopTicks;
+				}
+				samplesInBurst = 0;
+				burstReady = false;
 			}
-			adcFreeRunning(1);
-			
-			sensorADCCount.x /= NUM_READINGS;
-			sensorADCCount.y /= NUM_READINGS;
-			sensorADCCount.z /= NUM_READINGS;
-			
-			currentTime = millis();
-			if((currentTime % outputPeriod) <= 1){	
+			//A captured event goes out one frame at a time. Its frames wait for room in the transmit buffer rather than being dropped.
+			if(triggered && (eventCapture.state == TRIGGER_SENDING) && (uartTxFree() >= TRIGGER_MAX_PAYLOAD(axisCount) + FRAME_OVERHEAD)){
 				ledToggle();
-				if(mySettings.outputMode == OUTPUT_GRAVITY){
-					//Convert the values to Voltages
-					toVoltage(sensorADCCount.x, sensorVoltage.x);
-					toVoltage(sensorADCCount.y, sensorVoltage.y);
-					toVoltage(sensorADCCount.z, sensorVoltage.z);				
-					//Finally convert the voltages to Gs
-					toGValue(&sensorG, &sensorVoltage, &sensorCalibration, &sensorSwing);
-					printf("% 05.2f\t% 05.2f\t% 05.2f\n\r", sensorG.x, sensorG.y, sensorG.z);
+				if(frameSend(FRAME_TYPE_EVENT | frameAxes, frameSequence++, eventCapture.time, framePayload, triggerFrame(&eventCapture, framePayload)))performance.framesSent++;
+			}
+			//Set up the sampling for the settings. A command that changes them during the run has it set up again here,
+			//after the burst collected with the old settings has gone out.
+			if(streamSetup){
+				adcScanStop();
+				timer1Stop();
+				//The reply to the command goes out first, at the old baud rate (uartInit waits for it)
+				if(replyLength > 0)outputFrame(FRAME_TYPE_REPLY, frameSequence++, replyFrame, replyLength);
+				replyLength = 0;
+				if(commandSettings.baudRate != mySettings.baudRate)uartInit(baudRateSettings[commandSettings.baudRate]);
+				mySettings = commandSettings;
+				streamSetup = false;
+				
+				//Oversampling for n extra bits averages 4^n samples and only shifts the total by n
+				triggered = (mySettings.triggerMode != TRIGGER_OFF);
+				filtered = (mySettings.filter != FILTER_AVERAGE) && !triggered;
+				if(triggered){
+					//Events are made of the raw samples, and the output frequency is their sample rate
+					windowShift = 0;
+					valueShift = 0;
+					extraBits = 0;
+				}
+				else if(filtered){
+					//The filters have their own decimation, and keep the extra bits from their own fraction bits
+					windowShift = mySettings.filterShift;
+					valueShift = 0;
+					extraBits = mySettings.extraResolution;
+				}
+				else if(mySettings.extraResolution != 0){
+					windowShift = mySettings.extraResolution * 2;
+					valueShift = mySettings.extraResolution;
+					extraBits = windowShift - valueShift;
+				}
+				else{
+					windowShift = mySettings.averageShift;
+					valueShift = mySettings.averageShift;
+					extraBits = 0;
+				}
+				//The running total in the ADC interrupt isn't used when filtering
+				startAveraging(filtered ? 0 : windowShift);
+				sampleTail = sampleHead;
+				samplesInFrame = 0;
+				samplesInBurst = 0;
+				burstReady = false;
+				rangeSettle = 0;
+				
+				//Build the count to g conversion factors from the current calibration so the output loop doesn't need any floating point math
+				for(range=0; range < NUM_RANGES; range++){
+					computeGravityScale(&sensorGravity, &sensorCalibration[range], &sensorSwing[range], extraBits);
+					axisScale[range][X_AXIS] = sensorGravity.scale.x;
+					axisScale[range][Y_AXIS] = sensorGravity.scale.y;
+					axisScale[range][Z_AXIS] = sensorGravity.scale.z;
+					axisOffset[range][X_AXIS] = sensorGravity.offset.x;
+					axisOffset[range][Y_AXIS] = sensorGravity.offset.y;
+					axisOffset[range][Z_AXIS] = sensorGravity.offset.z;
+				}
+				
+				//Only the enabled axis are converted and output
+				axisCount = enabledAxes(mySettings.axisMask, axisChannel);
+				sampleLastAxis = axisChannel[axisCount - 1];
+				if(mySettings.axisMask == AXIS_MASK_ALL)frameAxes = 0;
+				else frameAxes = mySettings.axisMask << FRAME_AXES_SHIFT;
+				
+				//The filter runs at the sample rate. Its cutoff is kept below half the output frequency so nothing aliases.
+				if(filtered){
+					filterCutoff = mySettings.filterCutoff;
+					if(filterCutoff > mySettings.outputFrequency / 2)filterCutoff = mySettings.outputFrequency / 2;
+					filterInit(&sampleFilter, mySettings.filter, axisCount, windowShift, extraBits, (unsigned long)mySettings.outputFrequency << windowShift, filterCutoff);
 				}
-				else if(mySettings.outputMode == OUTPUT_RAW){
-					printf("%04ld\t%04ld\t%04ld\n\r", sensorADCCount.x, sensorADCCount.y, sensorADCCount.z);
+				if(triggered)triggerInit(&eventCapture, mySettings.triggerMode, axisCount, mySettings.triggerThreshold, mySettings.triggerPre, mySettings.triggerPost);
+				
+				//Timer 1 starts every conversion. Each output frame is the average of 2^windowShift samples,
+				//and each sample takes one conversion per enabled axis (two when discarding), so the samples are evenly
+				//spaced across the output period.
+				adcSetClock(mySettings.adcClock);
+				adcScanStart(axisChannel, axisCount, ADC_TRIGGER_TIMER1_COMPB, mySettings.adcDiscard);
+				timer1Init(((unsigned long)mySettings.outputFrequency << windowShift) * (axisCount << mySettings.adcDiscard));
+			}
+			//Any key except STATUS_REQUEST, STATUS_CLEAR, the range selections and binary commands stops measurement mode. Only the first
+			//character is consumed, anything typed after it stays in the receive buffer for the configuration menu.
+			if(uartAvailable()){
+				tempCharacter = uartReadChar();
+				range = activeRange;
+				//Binary commands start with the frame sync word, which isn't a key (see command.h)
+				if(commandPending(&commandIn, millis()) || (tempCharacter == (char)FRAME_SYNC1)){
+					if(!commandParse(&commandIn, tempCharacter, millis()))continue;
+					commandSettings = mySettings;
+					commandActions = runCommand(&commandIn, &commandSettings, true, replyFrame, &replyLength);
+					if(commandActions & COMMAND_ACTION_SETUP){
+						//The new settings (and the reply) wait until the burst collected so far has gone out in the old format
+						if(samplesInBurst > 0)burstReady = true;
+						streamSetup = true;
+						continue;
+					}
+					outputFrame(FRAME_TYPE_REPLY, frameSequence++, replyFrame, replyLength);
+					replyLength = 0;
+					if(commandActions & COMMAND_ACTION_STOP){
+						//Back to the configuration mode, without the menu
+						menuQuiet = true;
+						performance.txHighWater = uartTxHighWater;
+						runProgram = false;
+						break;
+					}
+					range = RANGE_INDEX(commandSettings.accelerometerRange);
+				}
+				else if(tempCharacter == STATUS_REQUEST){
+					outputFrame(FRAME_TYPE_STATUS, frameSequence++, statusFrame, statusPayload(statusFrame));
+					continue;
+				}
+				else if(tempCharacter == STATUS_CLEAR){
+					clearPerformanceCounters();
+					continue;
+				}
+				else if((tempCharacter == RANGE_SELECT_15) || (tempCharacter == RANGE_SELECT_60)){
+					range = (tempCharacter == RANGE_SELECT_60) ? RANGE_INDEX_60 : RANGE_INDEX_15;
+				}
+				else{
+					//The menu text fills the transmit buffer, so keep the high water mark of the run for the diagnostics
+					performance.txHighWater = uartTxHighWater;
+					runProgram = false;
+					break;
 				}
-				else if(mySettings.outputMode == OUTPUT_BINARY){
-					printf("#%c%c%c%c%c%c$",
-						(char)(sensorADCCount.x>>8), (char)sensorADCCount.x,
-						(char)(sensorADCCount.y>>8), (char)sensorADCCount.y,
-						(char)(sensorADCCount.z>>8), (char)sensorADCCount.z);
+				if(range != activeRange){
+					//The other range's calibration is already in RAM, so the switch takes effect from the next sample
+					activeRange = range;
+					mySettings.accelerometerRange = rangeSettings[range];
+					setAccelerometerRange(mySettings.accelerometerRange);
+					//Readings from the old range are still in the averaging window (and maybe the sample being converted),
+					//so throw samples away until they are all gone. The filters are cleared instead, once the sample being
+					//converted has gone. The burst collected so far goes out on its own.
+					samplesInFrame = 0;
+					if(filtered || triggered)rangeSettle = 1;
+					else rangeSettle = (1 << windowShift) + 1;
+					if(samplesInBurst > 0)burstReady = true;
 				}
+				continue;
+			}
+			//Count every new sample from the ADC interrupt. The interrupt keeps the running total of
+			//the window, so once the window is full its total is the frame average.
+			if(!getSample(&newSample))continue;
+			loopStart = timer2Ticks();
+			if(rangeSettle > 0){
+				//The window is clean once the last of these goes, so the next sample completes a frame
+				if(--rangeSettle == 0){
+					if(triggered)triggerReset(&eventCapture);
+					else if(filtered)filterReset(&sampleFilter);
+					else samplesInFrame = (1 << windowShift) - 1;
+				}
+				continue;
+			}
+			//In the trigger modes every sample goes into the event history, and nothing is sent until the threshold is crossed
+			if(triggered){
+				for(slot = 0; slot < axisCount; slot++)axisValue[slot] = newSample.axis[axisChannel[slot]];
+				if(eventCapture.state == TRIGGER_ARMED){
+					for(slot = 0; slot < axisCount; slot++)axisG[slot] = countToCentiG(axisValue[slot], axisScale[activeRange][axisChannel[slot]], axisOffset[activeRange][axisChannel[slot]]);
+					triggerCheck(&eventCapture, axisG, millis());
+				}
+				triggerAddSample(&eventCapture, axisValue);
+				loopTicks = timer2Ticks() - loopStart;
+				if(loopTicks > performance.maxLoopTicks)performance.maxLoopTicks = loopTicks;
+				continue;
+			}
+			//The filters take every sample, and give an output value once every 2^windowShift samples
+			if(filtered){
+				for(slot = 0; slot < axisCount; slot++)axisValue[slot] = newSample.axis[axisChannel[slot]];
+				filterAddSample(&sampleFilter, axisValue);
+			}
+			if(++samplesInFrame < (1 << windowShift))continue;
+			samplesInFrame = 0;
+			
+			if(filtered){
+				//A CIC filter that is still filling up after a reset has nothing to output yet
+				if(!filterOutput(&sampleFilter, axisValue))continue;
+			}
+			else for(slot = 0; slot < axisCount; slot++)axisValue[slot] = newSample.sum[axisChannel[slot]] >> valueShift;
+			
+			ledToggle();
+			if(mySettings.outputMode == OUTPUT_GRAVITY){
+				//Convert the counts straight to Gs and print them in the same format as printf("% 05.2f")
+				for(slot = 0; slot < axisCount; slot++){
+					printCentiG(countToCentiG(axisValue[slot], axisScale[activeRange][axisChannel[slot]], axisOffset[activeRange][axisChannel[slot]]), (slot == axisCount - 1) ? '\n' : '\t');
+				}
+				putchar('\r');
+				performance.framesSent++;
+			}
+			else if(mySettings.outputMode == OUTPUT_RAW){
+				for(slot = 0; slot < axisCount; slot++)printf_P(PSTR("%04u%c"), axisValue[slot], (slot == axisCount - 1) ? '\n' : '\t');
+				putchar('\r');
+				performance.framesSent++;
+			}
+			else if(mySettings.outputMode == OUTPUT_BINARY){
+				putchar('#');
+				for(slot = 0; slot < axisCount; slot++){
+					putchar(axisValue[slot] >> 8);
+					putchar(axisValue[slot]);
+				}
+				putchar('$');
+				performance.framesSent++;
+			}
+			else if(mySettings.outputMode == OUTPUT_FRAMED){
+				//Goes straight to the UART transmit buffer. If the frame doesn't fit it is dropped, but its
+				//sequence number is still used so the host can count the loss.
+				for(slot = 0; slot < axisCount; slot++)putBigEndian(&framePayload[slot * 2], axisValue[slot]);
+				outputFrame(FRAME_TYPE_SAMPLE | frameAxes, frameSequence++, framePayload, axisCount * 2);
 			}
-			if(UCSR0A & (1<<RXC0)){
-				tempCharacter = UDR0;
-				runProgram = false;
-			}			
+			else if((mySettings.outputMode == OUTPUT_BURST) || (mySettings.outputMode == OUTPUT_PACKED)){
+				//Collect burstSize samples and send them together with a single header and CRC
+				//(sent at the top of the loop once it is full)
+				for(slot = 0; slot < axisCount; slot++)putBigEndian(&framePayload[(samplesInBurst * axisCount + slot) * 2], axisValue[slot]);
+				if(++samplesInBurst >= mySettings.burstSize)burstReady = true;
+			}
+			else if(mySettings.outputMode == OUTPUT_DELTA){
+				//Each frame starts with a keyframe, then the rest of the burst is sent as small differences
+				if(samplesInBurst == 0)deltaStart(&compressor, framePayload, axisCount);
+				deltaAddSample(&compressor, axisValue);
+				if(++samplesInBurst >= mySettings.burstSize)burstReady = true;
+			}
+			loopTicks = timer2Ticks() - loopStart;
+			if(loopTicks > performance.maxLoopTicks)performance.maxLoopTicks = loopTicks;
 		}
 	}
 	
@@ -358,38 +712,27 @@ void IOInit(void)
 }
 
 
-void selectAccelerometerRange(struct settings* newSettings, struct sensorReadings* swingValues)
+void selectAccelerometerRange(struct settings* newSettings)
 {
 	char tempValue=0;
 	
-	printf("Select the desired accelerometer range.\n\r");
-	printf("[1] +/- 1.5g\n\r");
-	printf("[2] +/- 6.0g\n\r");
+	printf_P(PSTR("Select the desired accelerometer range.\n\r"));
+	printf_P(PSTR("[1] +/- 1.5g\n\r"));
+	printf_P(PSTR("[2] +/- 6.0g\n\r"));
 	tempValue = uartGetChar();
 	
 	switch(tempValue){
 		case '1':
 			newSettings->accelerometerRange = RANGE_15;
-			//Reinitialize the swing values to default for this mode
-			//TODO: Make seperate swing settings for high/low ranges
-			swingValues->x=RANGE_15;
-			swingValues->y=RANGE_15;
-			swingValues->z=RANGE_15;
 			break;
 		case '2':
 			newSettings->accelerometerRange = RANGE_60;
-			//Reinitialize the swing values to default for this mode
-			//TODO: Make seperate swing settings for high/low ranges
-			swingValues->x=RANGE_60;
-			swingValues->y=RANGE_60;
-			swingValues->z=RANGE_60;			
 			break;
 		default:
-			printf("Invalid Selection");
+			printf_P(PSTR("Invalid Selection"));
 			break;
 	}	
-	saveSwing(swingValues);
-	printf("\n\n\r");
+	printf_P(PSTR("\n\n\r"));
 }
 
 //Description: Displays a configuration menu to the user.
@@ -399,121 +742,297 @@ void selectAccelerometerRange(struct settings* newSettings, struct sensorReading
 char configMenu(struct settings* menuSettings, struct sensorReadings* menuCalibrationValues)
 {
 	//Display the Config Menu welcome dialoge
-	printf("--- Serial Accelerometer Dongle MMA7361 ---\n\r");
-	printf("          Firmware Version 6.0\n\n\r");
-	printf("Select a menu item to continue:\n\r");
+	printf_P(PSTR("--- Serial Accelerometer Dongle MMA7361 ---\n\r"));
+	printf_P(PSTR("          Firmware Version 6.0\n\n\r"));
+	printf_P(PSTR("Select a menu item to continue:\n\r"));
 	//Display the config menu options
-	printf("[1] Calibrate (Current Calibration Values: %ld, %ld, %ld)\n\r", menuCalibrationValues->x, menuCalibrationValues->y, menuCalibrationValues->z);
-	printf("[2] Output Mode (");
+	printf_P(PSTR("[1] Calibrate (Current Calibration Values: %ld, %ld, %ld)\n\r"), menuCalibrationValues->x, menuCalibrationValues->y, menuCalibrationValues->z);
+	printf_P(PSTR("[2] Output Mode ("));
 	//Display the current output mode of the accelerometer data
 	switch(menuSettings->outputMode){
-		case OUTPUT_GRAVITY: printf("Gravity Values");
+		case OUTPUT_GRAVITY: printf_P(PSTR("Gravity Values"));
+			break;
+		case OUTPUT_RAW: printf_P(PSTR("Raw ADC Values"));
+			break;
+		case OUTPUT_BINARY: printf_P(PSTR("Raw ADC Values in Binary Format"));
+			break;
+		case OUTPUT_FRAMED: printf_P(PSTR("Framed Binary with Sequence Numbers and CRC"));
 			break;
-		case OUTPUT_RAW: printf("Raw ADC Values");
+		case OUTPUT_BURST: printf_P(PSTR("Framed Binary Bursts of %d Samples"), menuSettings->burstSize);
 			break;
-		case OUTPUT_BINARY: printf("Raw ADC Values in Binary Format");
+		case OUTPUT_PACKED: printf_P(PSTR("Packed 10 Bit Bursts of %d Samples"), menuSettings->burstSize);
+			break;
+		case OUTPUT_DELTA: printf_P(PSTR("Delta Compressed Bursts of %d Samples"), menuSettings->burstSize);
 			break;
 		default:
 			break;
 	}
-	printf(")\n\r");
-	printf("[3] Output Frequency (%d Hz)\n\r", menuSettings->outputFrequency);
-	printf("[4] Sensor Range (+/- ");
+	printf_P(PSTR(")\n\r"));
+	printf_P(PSTR("[3] Output Frequency (%d Hz)\n\r"), menuSettings->outputFrequency);
+	printf_P(PSTR("[4] Sensor Range (+/- "));
 	switch(menuSettings->accelerometerRange){
-		case RANGE_60: printf("6.0g");
+		case RANGE_60: printf_P(PSTR("6.0g"));
 			break;
-		case RANGE_15: printf("1.5g");
+		case RANGE_15: printf_P(PSTR("1.5g"));
 			break;
 	}
-	printf(")\n\r");
-	printf("[5] Baud Rate (%lu)\n\r", baudRateSettings[menuSettings->baudRate]);
-	printf("[x] Exit\n\r");
-	printf("Selection: ");
+	printf_P(PSTR(")\n\r"));
+	printf_P(PSTR("[5] Baud Rate (%lu)\n\r"), baudRateSettings[menuSettings->baudRate]);
+	printf_P(PSTR("[6] Averaging (%d samples)\n\r"), 1 << menuSettings->averageShift);
+	printf_P(PSTR("[7] Resolution (%d bits)\n\r"), 10 + menuSettings->extraResolution);
+	printf_P(PSTR("[8] Burst Size (%d samples)\n\r"), menuSettings->burstSize);
+	printf_P(PSTR("[9] Diagnostics\n\r"));
+	printf_P(PSTR("[a] ADC Clock (%lu kHz"), adcClockRate(menuSettings->adcClock) / 1000);
+	if(menuSettings->adcDiscard)printf_P(PSTR(", Discarding After Channel Switch"));
+	printf_P(PSTR(")\n\r"));
+	printf_P(PSTR("[b] Axes ("));
+	printAxes(menuSettings->axisMask);
+	printf_P(PSTR(")\n\r"));
+	printf_P(PSTR("[c] Filter ("));
+	printFilter(menuSettings);
+	printf_P(PSTR(")\n\r"));
+	printf_P(PSTR("[d] Trigger ("));
+	printTrigger(menuSettings);
+	printf_P(PSTR(")\n\r"));
+	printf_P(PSTR("[x] Exit\n\r"));
+	printf_P(PSTR("Selection: "));
 	
 	return uartGetChar();
 }
 
-void toGValue(struct sensorValues* gValue, struct sensorReadings* voltage, struct sensorReadings* calibration, struct sensorReadings* swing){
-	gValue->x = ((double)(voltage->x) - (double)(calibration->x))/(double)swing->x;
-	gValue->y = ((double)(voltage->y) - (double)(calibration->y))/(double)swing->y;
-	gValue->z = ((double)(voltage->z) - (double)(calibration->z))/(double)swing->z;
+//Description: Takes the oldest unread sample from the ADC interrupt's sample ring.
+// The interrupt only ever writes the slot at sampleHead, so a slot can be copied without stopping the ADC.
+// If the interrupt has lapped the main loop the copy may be torn, so it is checked after the copy and the
+// missed samples are skipped (and counted in performance.samplesDropped).
+//Parameters: sample - filled in with the 3 axis ADC counts
+//Returns: true if a sample was read, false if there is no new sample yet
+//Usage: if(getSample(&newSample))...
+bool getSample(struct adcSample* sample)
+{
+	unsigned char sequence = sampleTail;
+	unsigned char behind;
+	volatile struct adcSample* slot = &sampleBuffer[sequence & SAMPLE_BUFFER_MASK];
+	
+	if(sequence == sampleHead)return false;
+	
+	sample->axis[X_AXIS] = slot->axis[X_AXIS];
+	sample->axis[Y_AXIS] = slot->axis[Y_AXIS];
+	sample->axis[Z_AXIS] = slot->axis[Z_AXIS];
+	sample->sum[X_AXIS] = slot->sum[X_AXIS];
+	sample->sum[Y_AXIS] = slot->sum[Y_AXIS];
+	sample->sum[Z_AXIS] = slot->sum[Z_AXIS];
+	
+	//The slot is only safe if the interrupt hasn't started writing it again
+	behind = sampleHead - sequence;
+	if(behind >= SAMPLE_BUFFER_SIZE){
+		performance.samplesDropped += behind - (SAMPLE_BUFFER_SIZE - 1);
+		sampleTail = sampleHead - (SAMPLE_BUFFER_SIZE - 1);
+		return false;
+	}
+	sampleTail = sequence + 1;
+	return true;
 }
 
-//TODO: Make this function smaller
-void selectCalibrationValues(struct sensorReadings* newCalibrationValues, struct sensorReadings* swingValues){
-	unsigned long int tempMax=0, tempMin=0;
+//Description: Precomputes the fixed point factors that turn an ADC count into hundredths of a g.
+// g = (count * 3300/1023 - calibration) / swing, so with Q16 factors
+// centi-g = (count * scale - offset) / 65536 where scale = 65536 * 330000/(1023*swing) and offset = 65536 * 100*calibration/swing
+//Parameters: conversion - filled in with the per axis factors
+//			  calibration - the 0g offset of each axis in mV
+//			  swing - the mV per g of each axis
+//			  extraBits - bits of resolution added by oversampling (the counts are 2^extraBits times larger)
+//Usage: computeGravityScale(&sensorGravity, &sensorCalibration, &sensorSwing, 0);
+void computeGravityScale(struct gravityConversion* conversion, struct sensorReadings* calibration, struct sensorReadings* swing, char extraBits)
+{
+	//100 * mV per count in Q10 (330000 * 1024 still fits in 32 bits)
+	const unsigned long centiMvPerCount = ((ADC_REFERENCE_MV * 100) << 10) / ADC_FULL_SCALE;
+	unsigned long *scale = &conversion->scale.x, *offset = &conversion->offset.x;
+	unsigned long *cal = &calibration->x, *sw = &swing->x;
+	unsigned long axisSwing, whole, remainder;
+	
+	for(char axis=0; axis < 3; axis++){
+		axisSwing = sw[(int)axis];
+		if(axisSwing < MIN_SWING_MV)axisSwing = MIN_SWING_MV;
 		
-	printf("Calibration Menu (Press X at any time to Exit)\n\r");
-	printf("For each axis you will be prompted to find the maximum and minimum values.\n\r");
-	printf("Simply rotate the serial accelerometer until you find the appropriate value and\n\r");
-	printf("press a key (any key except x) to register the value\n\r");
-	
-	//Calibrate the X Axis
-	printf("Calibrate X Axis\n\r");
-	printf("Find Maximum X Value:\n\r");
-	while( !(UCSR0A & (1<<RXC0)) ){
-		tempMax = adcRead(X_AXIS);
-		printf("X:\t%lu\r", tempMax);
-		delayMs(50);
-	}
-	if(toupper(UDR0)=='X')return;
-	printf("Find Minimum X Value\n\r");
-	while( !(UCSR0A & (1<<RXC0)) ){
-		tempMin = adcRead(X_AXIS);
-		printf("X:\t%lu\r", tempMin);
-		delayMs(50);
-	}
-	if(toupper(UDR0)=='X')return;
-	toVoltage(((tempMax - tempMin)/2), swingValues->x);
-	toVoltage((((tempMax - tempMin)/2) + tempMin), newCalibrationValues->x);
-	
-	//Calibrate Y Axis
-	printf("Calibrate Y Axis\n\r");
-	printf("Find Maximum Y Value:\n\r");
-	while( !(UCSR0A & (1<<RXC0)) ){
-		tempMax = adcRead(Y_AXIS);
-		printf("Y:\t%lu\r", tempMax);
-		delayMs(50);
-	}
-	if(toupper(UDR0)=='X')return;
-	printf("Find Minimum Y Value\n\r");
-	while( !(UCSR0A & (1<<RXC0)) ){
-		tempMin = adcRead(Y_AXIS);
-		printf("Y:\t%lu\r", tempMin);
-		delayMs(50);
-	}
-	if(toupper(UDR0)=='X')return;
-	toVoltage(((tempMax - tempMin)/2), swingValues->y);
-	toVoltage((((tempMax - tempMin)/2) + tempMin), newCalibrationValues->y);
-	
-	//Calibrate Z Axis
-	printf("Calibrate Z Axis\n\r");
-	printf("Find Maximum Z Value:\n\r");
-	while( !(UCSR0A & (1<<RXC0)) ){
-		tempMax = adcRead(Z_AXIS);
-		printf("Z:\t%lu\r", tempMax);
-		delayMs(50);
-	}
-	if(toupper(UDR0)=='X')return;
-	printf("Find Minimum Z Value\n\r");
-	while( !(UCSR0A & (1<<RXC0)) ){
-		tempMin = adcRead(Z_AXIS);
-		printf("Z:\t%lu\r", tempMin);
-		delayMs(50);
-	}
-	if(toupper(UDR0)=='X')return;
-	toVoltage(((tempMax - tempMin)/2), swingValues->z);
-	toVoltage((((tempMax - tempMin)/2) + tempMin), newCalibrationValues->z);
-	
-	printf("\n\n\r");
+		scale[(int)axis] = ((centiMvPerCount << 6) + (axisSwing << extraBits)/2) / (axisSwing << extraBits);
+		//Do the offset division in two steps so the Q16 value doesn't overflow
+		whole = (cal[(int)axis] * 100) / axisSwing;
+		remainder = (cal[(int)axis] * 100) % axisSwing;
+		offset[(int)axis] = (whole << 16) + ((remainder << 16) + axisSwing/2) / axisSwing;
+	}
+}
+
+//Description: Converts an ADC count to hundredths of a g using the factors from computeGravityScale
+//Returns: The g value * 100, rounded to the nearest hundredth
+//Usage: x = countToCentiG(sensorADCCount.x, sensorGravity.scale.x, sensorGravity.offset.x);
+int countToCentiG(unsigned int count, unsigned long scale, unsigned long offset)
+{
+	long value = (long)(count * scale - offset);
+	
+	return (int)((value + 0x8000) >> 16);
+}
+
+//Description: Prints a value in hundredths of a g the same way printf("% 05.2f", value/100.0) would, followed by the terminator character.
+// i.e. 98 -> " 0.98", -123 -> "-1.23"
+//Usage: printCentiG(-123, '\t');
+void printCentiG(int value, char terminator)
+{
+	char text[8];
+	char *position = &text[sizeof(text)];
+	unsigned int magnitude;
+	
+	if(value < 0)magnitude = -value;
+	else magnitude = value;
+	
+	*--position = terminator;
+	*--position = '0' + magnitude % 10;
+	magnitude /= 10;
+	*--position = '0' + magnitude % 10;
+	magnitude /= 10;
+	*--position = '.';
+	do{
+		*--position = '0' + magnitude % 10;
+		magnitude /= 10;
+	}while(magnitude);
+	*--position = (value < 0) ? '-' : ' ';
+	
+	while(position < &text[sizeof(text)])putchar(*position++);
+}
+
+//Description: Leads the user through the six position calibration. The board is put down still on each of its
+// 6 sides in any order, and each side is recognised and measured automatically (see captureStillPose).
+// The 0g offset of each axis is half way between its +1g and -1g readings, and the swing is half the difference.
+//Parameters: newCalibrationValues, swingValues - set to the new values (in mV) when all 6 sides have been measured.
+//			  They are left alone if the calibration is cancelled or fails.
+//Usage: selectCalibrationValues(&sensorCalibration, &sensorSwing);
+void selectCalibrationValues(struct sensorReadings* newCalibrationValues, struct sensorReadings* swingValues){
+	const char axisNames[3] = {'X', 'Y', 'Z'};
+	//Reading totals of each side (X+, X-, Y+, Y-, Z+, Z-), indexed by ADC channel
+	unsigned long poseTotals[6][3];
+	unsigned long totals[3], *plus, *minus;
+	unsigned long offset[3], swing[3];
+	unsigned char captured=0, count=0, slot;
+	char pose, lastPose=-1;
+	
+	printf_P(PSTR("Calibration Menu (Press X at any time to Exit)\n\r"));
+	printf_P(PSTR("Put the serial accelerometer down on each of its 6 sides, in any order, and keep it still\n\r"));
+	printf_P(PSTR("until the side is captured (about %d seconds).\n\r"), (CALIBRATION_SAMPLES + CALIBRATION_SAMPLE_RATE / 2) / CALIBRATION_SAMPLE_RATE);
+	
+	//Sample all 3 axis through the ADC interrupt, the same way measurement mode does
+	startAveraging(CALIBRATION_WINDOW_SHIFT);
+	sampleLastAxis = axisScanOrder[2];
+	sampleTail = sampleHead;
+	adcScanStart(axisScanOrder, 3, ADC_TRIGGER_TIMER1_COMPB, 0);
+	timer1Init(CALIBRATION_SAMPLE_RATE * 3UL);
+	
+	while(captured != 0x3F){
+		if(!captureStillPose(totals)){
+			if(toupper(uartReadChar()) == 'X')break;
+			continue;
+		}
+		//Wait for the next side if the board is tilted or hasn't been turned over yet
+		pose = findPose(totals, newCalibrationValues);
+		if((pose < 0) || (pose == lastPose))continue;
+		lastPose = pose;
+		memcpy(poseTotals[(int)pose], totals, sizeof(totals));
+		if(!(captured & (1 << pose)))count++;
+		captured |= 1 << pose;
+		printf_P(PSTR("Captured %c%c (%d of 6)\n\r"), axisNames[pose >> 1], (pose & 1) ? '-' : '+', count);
+	}
+	adcScanStop();
+	timer1Stop();
+	if(captured != 0x3F){
+		printf_P(PSTR("\n\n\r"));
+		return;
+	}
+	
+	//Turn the totals into averages in 1/64ths of a count, so the mV values keep their accuracy
+	for(pose=0; pose < 6; pose++){
+		for(slot=0; slot < 3; slot++)poseTotals[(int)pose][slot] >>= CALIBRATION_SAMPLE_SHIFT - 6;
+	}
+	for(slot=0; slot < 3; slot++){
+		plus = poseTotals[slot * 2];
+		minus = poseTotals[slot * 2 + 1];
+		offset[slot] = ((plus[axisScanOrder[slot]] + minus[axisScanOrder[slot]]) * ADC_REFERENCE_MV + ADC_FULL_SCALE * 64) / (ADC_FULL_SCALE * 128);
+		swing[slot] = ((plus[axisScanOrder[slot]] - minus[axisScanOrder[slot]]) * ADC_REFERENCE_MV + ADC_FULL_SCALE * 64) / (ADC_FULL_SCALE * 128);
+		if(swing[slot] < MIN_SWING_MV){
+			printf_P(PSTR("%c Axis Fails! (swing %lu mV)\n\n\r"), axisNames[slot], swing[slot]);
+			return;
+		}
+		printf_P(PSTR("%c:\t0g at %lu mV, %lu mV/g\n\r"), axisNames[slot], offset[slot], swing[slot]);
+	}
+	
+	newCalibrationValues->x = offset[0];
+	newCalibrationValues->y = offset[1];
+	newCalibrationValues->z = offset[2];
+	swingValues->x = swing[0];
+	swingValues->y = swing[1];
+	swingValues->z = swing[2];
+	printf_P(PSTR("\n\n\r"));
+}
+
+//Description: Collects CALIBRATION_SAMPLES samples of all 3 axis from the ADC interrupt while the board is still.
+// The board counts as still while the window average of every axis stays within CALIBRATION_MAX_NOISE counts.
+// If it moves, the collection starts again.
+//Parameters: totals - set to the total of the readings of each axis, indexed by ADC channel
+//Returns: true once the samples are collected, false if a key was pressed (the key is left in the receive buffer)
+bool captureStillPose(unsigned long* totals){
+	struct adcSample sample;
+	unsigned int count=0, low[3], high[3];
+	unsigned char axis;
+	
+	while(count < CALIBRATION_SAMPLES){
+		if(uartAvailable())return false;
+		if(!getSample(&sample))continue;
+		for(axis=0; axis < 3; axis++){
+			if(count == 0){
+				totals[axis] = 0;
+				low[axis] = high[axis] = sample.sum[axis];
+			}
+			if(sample.sum[axis] < low[axis])low[axis] = sample.sum[axis];
+			if(sample.sum[axis] > high[axis])high[axis] = sample.sum[axis];
+			totals[axis] += sample.axis[axis];
+		}
+		count++;
+		for(axis=0; axis < 3; axis++){
+			if((high[axis] - low[axis]) > (CALIBRATION_MAX_NOISE << CALIBRATION_WINDOW_SHIFT))count = 0;
+		}
+	}
+	return true;
+}
+
+//Description: Works out which side the board is lying on from the reading totals of captureStillPose.
+// One axis has to be well clear of its 0g offset, and at least twice as far from it as either of the others.
+//Parameters: totals - the reading totals of each axis, indexed by ADC channel
+//			  calibration - the current 0g offsets in mV, used as the middle of each axis
+//Returns: The side (0 X+, 1 X-, 2 Y+, 3 Y-, 4 Z+, 5 Z-), or -1 if the board is tilted
+char findPose(unsigned long* totals, struct sensorReadings* calibration){
+	unsigned long* middle = &calibration->x;
+	long deviation[3];
+	unsigned long size[3];
+	unsigned char slot, largest=0;
+	
+	for(slot=0; slot < 3; slot++){
+		deviation[slot] = (long)(totals[axisScanOrder[slot]] >> CALIBRATION_SAMPLE_SHIFT) - (long)(middle[slot] * ADC_FULL_SCALE / ADC_REFERENCE_MV);
+		size[slot] = labs(deviation[slot]);
+		if(size[slot] > size[largest])largest = slot;
+	}
+	if(size[largest] < (MIN_SWING_MV * ADC_FULL_SCALE / ADC_REFERENCE_MV))return -1;
+	for(slot=0; slot < 3; slot++){
+		if((slot != largest) && (size[slot] * 2 > size[largest]))return -1;
+	}
+	return largest * 2 + (deviation[largest] < 0);
 }
 
 void selectOutputMode(struct settings* newSettings){
 	char tempModeSelection=0;
-	printf("Select the desired output mode\n\r");
-	printf("[1] Gravity Values\n\r");
-	printf("[2] Raw Values\n\r");
-	printf("[3] Raw Values in Binary Format\n\r");
+	printf_P(PSTR("Select the desired output mode\n\r"));
+	printf_P(PSTR("[1] Gravity Values\n\r"));
+	printf_P(PSTR("[2] Raw Values\n\r"));
+	printf_P(PSTR("[3] Raw Values in Binary Format\n\r"));
+	printf_P(PSTR("[4] Framed Binary (sequence number, timestamp and CRC)\n\r"));
+	printf_P(PSTR("[5] Framed Binary Bursts (several samples per frame)\n\r"));
+	printf_P(PSTR("[6] Packed 10 Bit Bursts (4 bytes per sample)\n\r"));
+	printf_P(PSTR("[7] Delta Compressed Bursts (as little as 1.5 bytes per sample)\n\r"));
 	tempModeSelection = uartGetChar();
 	switch(tempModeSelection){
 		case '1':
@@ -525,45 +1044,670 @@ void selectOutputMode(struct settings* newSettings){
 		case '3':
 			newSettings->outputMode = OUTPUT_BINARY;
 			break;
+		case '4':
+			newSettings->outputMode = OUTPUT_FRAMED;
+			break;
+		case '5':
+			newSettings->outputMode = OUTPUT_BURST;
+			break;
+		case '6':
+			newSettings->outputMode = OUTPUT_PACKED;
+			break;
+		case '7':
+			newSettings->outputMode = OUTPUT_DELTA;
+			break;
 		default:
-			printf("Invalid Selection.\n\r");
+			printf_P(PSTR("Invalid Selection.\n\r"));
 	}
-	printf("\n\n\r");
+	printf_P(PSTR("\n\n\r"));
 }
 
 void selectOutputFrequency(struct settings* newSettings){
 	char tempValue=0;
 	
-	printf("Set the desired output frequency. Press [i] to increase and [d] to decrease.\n\rPress [x] to exit\n\r");
-	printf("Frequency range is limited automatically by the output mode and baud rate\n\r");
-	printf("Output Frequency: %3d\r", newSettings->outputFrequency);
+	unsigned int limit = maxOutputFrequency(newSettings);
+	
+	printf_P(PSTR("Set the desired output frequency. Press [i] to increase and [d] to decrease.\n\rPress [I] and [D] to change it by 10. Press [x] to exit\n\r"));
+	printf_P(PSTR("Frequency range is limited automatically by the output mode and baud rate\n\r"));
+	if(newSettings->filter != FILTER_AVERAGE)printf_P(PSTR("The limit with a CIC or IIR filter uses estimated filter cycle costs that haven't been measured yet\n\r"));
+	printf_P(PSTR("Output Frequency: %4d\r"), newSettings->outputFrequency);
 	tempValue = uartGetChar();
 	while(tolower(tempValue) != 'x'){
-		if((tolower(tempValue)=='i') && (newSettings->outputFrequency < outputFrequencyLimits[newSettings->outputMode][newSettings->baudRate]))
-			newSettings->outputFrequency += 1;
-		if((tolower(tempValue)=='d') && (newSettings->outputFrequency >= 1))newSettings->outputFrequency -= 1;
-		printf("Output Frequency: %3d\r", newSettings->outputFrequency);
+		if(tempValue=='i')newSettings->outputFrequency += 1;
+		if(tempValue=='I')newSettings->outputFrequency += 10;
+		if(tempValue=='d')newSettings->outputFrequency -= 1;
+		if(tempValue=='D')newSettings->outputFrequency -= 10;
+		if(newSettings->outputFrequency > (int)limit)newSettings->outputFrequency = limit;
+		if(newSettings->outputFrequency < 1)newSettings->outputFrequency = 1;
+		printf_P(PSTR("Output Frequency: %4d\r"), newSettings->outputFrequency);
 		tempValue = uartGetChar();
 	}
-	printf("\n\n\r");
+	printf_P(PSTR("\n\n\r"));
 }
 
 void selectBaudRate(struct settings* newSettings){
 	char tempValue=0;
+	unsigned int ubrr;
+	char doubleSpeed;
+	
+	printf_P(PSTR("Select the desired baud rate.\n\r"));
+	printf_P(PSTR("[1] 4800\n\r"));
+	printf_P(PSTR("[2] 9600\n\r"));
+	printf_P(PSTR("[3] 14400\n\r"));
+	printf_P(PSTR("[4] 19200\n\r"));
+	printf_P(PSTR("[5] 38400\n\r"));
+	printf_P(PSTR("[6] 57600\n\r"));
+	printf_P(PSTR("[7] 115200\n\r"));
+	printf_P(PSTR("[8] 250000\n\r"));
+	printf_P(PSTR("[9] 500000\n\r"));
+	printf_P(PSTR("[a] 1000000\n\r"));
+	
+	tempValue = tolower(uartGetChar());
+	if(tempValue == 'a')tempValue = '1' + BAUD_1000000;
+	if(tempValue >= '1' && tempValue < '1' + NUM_BAUD_RATES){
+		//Don't switch to a baud rate the UART can't make accurately at this clock speed
+		if(uartBaudSetting(baudRateSettings[tempValue-'1'], &ubrr, &doubleSpeed) > UART_MAX_BAUD_ERROR)
+			printf_P(PSTR("That baud rate can't be used at this clock speed!"));
+		else newSettings->baudRate = tempValue-'1';
+	}
+	else printf_P(PSTR("Invalid Selection!"));
+	printf_P(PSTR("\n\n\r"));
+}
+
+void selectBurstSize(struct settings* newSettings){
+	char tempValue=0;
+	
+	printf_P(PSTR("Set the number of samples in each burst frame. Press [i] to increase and [d] to decrease.\n\rPress [x] to exit\n\r"));
+	printf_P(PSTR("Burst Size: %2d\r"), newSettings->burstSize);
+	tempValue = uartGetChar();
+	while(tolower(tempValue) != 'x'){
+		if((tolower(tempValue)=='i') && (newSettings->burstSize < MAX_BURST_SIZE))newSettings->burstSize += 1;
+		if((tolower(tempValue)=='d') && (newSettings->burstSize > 1))newSettings->burstSize -= 1;
+		printf_P(PSTR("Burst Size: %2d\r"), newSettings->burstSize);
+		tempValue = uartGetChar();
+	}
+	printf_P(PSTR("\n\n\r"));
+}
+
+void selectAveraging(struct settings* newSettings){
+	char tempValue=0;
+	
+	printf_P(PSTR("Select the number of readings to average for each output value.\n\r"));
+	printf_P(PSTR("[1] 1\n\r"));
+	printf_P(PSTR("[2] 2\n\r"));
+	printf_P(PSTR("[3] 4\n\r"));
+	printf_P(PSTR("[4] 8\n\r"));
+	printf_P(PSTR("[5] 16\n\r"));
+	
+	tempValue = uartGetChar();
+	if(tempValue >= '1' && tempValue <= '1' + MAX_AVERAGE_SHIFT)newSettings->averageShift = tempValue-'1';
+	else printf_P(PSTR("Invalid Selection!"));
+	printf_P(PSTR("\n\n\r"));
+}
+
+void selectAdcClock(struct settings* newSettings){
+	char tempValue=0;
 	
-	printf("Select the desired baud rate.\n\r");
-	printf("[1] 4800\n\r");
-	printf("[2] 9600\n\r");
-	printf("[3] 14400\n\r");
-	printf("[4] 19200\n\r");
-	printf("[5] 38400\n\r");
-	printf("[6] 57600\n\r");
-	printf("[7] 115200\n\r");
+	printf_P(PSTR("Select the ADC clock. A faster clock allows higher sample rates but is less accurate.\n\r"));
+	printf_P(PSTR("[1] %lu kHz (full 10 bit accuracy)\n\r"), adcClockRate(ADC_CLOCK_STANDARD) / 1000);
+	printf_P(PSTR("[2] %lu kHz (about 9 effective bits)\n\r"), adcClockRate(ADC_CLOCK_FAST) / 1000);
+	printf_P(PSTR("[3] %lu kHz (about 8 effective bits)\n\r"), adcClockRate(ADC_CLOCK_FASTEST) / 1000);
+	printf_P(PSTR("[d] Discard the first reading after each channel switch ("));
+	printf_P(newSettings->adcDiscard ? PSTR("On") : PSTR("Off"));
+	printf_P(PSTR(", halves the sample rate)\n\r"));
 	
+	tempValue = tolower(uartGetChar());
+	if(tempValue >= '1' && tempValue < '1' + NUM_ADC_CLOCKS)newSettings->adcClock = tempValue-'1';
+	else if(tempValue == 'd')newSettings->adcDiscard = !newSettings->adcDiscard;
+	else printf_P(PSTR("Invalid Selection!"));
+	printf_P(PSTR("\n\n\r"));
+}
+
+void selectAxes(struct settings* newSettings){
+	char tempValue=0;
+	int toggled;
+	
+	printf_P(PSTR("Select the axis to sample and output. Leaving axis out allows higher output frequencies.\n\r"));
+	printf_P(PSTR("Press [1], [2] or [3] to turn X, Y or Z on or off. Press [x] to exit\n\r"));
+	printf_P(PSTR("Axes: "));
+	printAxes(newSettings->axisMask);
+	printf_P(PSTR("     \r"));
 	tempValue = uartGetChar();
-	if(tempValue >= '1' && tempValue <= '7')newSettings->baudRate = tempValue-'1';
-	else printf("Invalid Selection!");
-	printf("\n\n\r");
+	while(tolower(tempValue) != 'x'){
+		if((tempValue >= '1') && (tempValue <= '3')){
+			toggled = newSettings->axisMask ^ (1 << axisScanOrder[tempValue - '1']);
+			//At least one axis has to stay on
+			if(toggled != 0)newSettings->axisMask = toggled;
+		}
+		printf_P(PSTR("Axes: "));
+		printAxes(newSettings->axisMask);
+		printf_P(PSTR("     \r"));
+		tempValue = uartGetChar();
+	}
+	printf_P(PSTR("\n\n\r"));
+}
+
+void selectResolution(struct settings* newSettings){
+	char tempValue=0;
+	
+	printf_P(PSTR("Select the output resolution. Extra bits are gained by oversampling,\n\r"));
+	printf_P(PSTR("which replaces the averaging setting.\n\r"));
+	printf_P(PSTR("[1] 10 bits\n\r"));
+	printf_P(PSTR("[2] 11 bits (average of 4 samples)\n\r"));
+	printf_P(PSTR("[3] 12 bits (average of 16 samples)\n\r"));
+	
+	tempValue = uartGetChar();
+	if(tempValue >= '1' && tempValue <= '1' + MAX_EXTRA_RESOLUTION)newSettings->extraResolution = tempValue-'1';
+	else printf_P(PSTR("Invalid Selection!"));
+	printf_P(PSTR("\n\n\r"));
+}
+
+void selectFilter(struct settings* newSettings){
+	char tempValue=0;
+	
+	printf_P(PSTR("Select the filter that reduces the samples to the output frequency.\n\r"));
+	printf_P(PSTR("[1] Average (set by the averaging and resolution settings)\n\r"));
+	printf_P(PSTR("[2] 2nd Order CIC\n\r"));
+	printf_P(PSTR("[3] 3rd Order CIC\n\r"));
+	printf_P(PSTR("[4] 1st Order IIR Low-Pass\n\r"));
+	printf_P(PSTR("[5] 2nd Order IIR Low-Pass\n\r"));
+	
+	tempValue = uartGetChar();
+	if(tempValue >= '1' && tempValue < '1' + NUM_FILTERS)newSettings->filter = tempValue-'1';
+	else{
+		printf_P(PSTR("Invalid Selection!\n\n\r"));
+		return;
+	}
+	if(newSettings->filter == FILTER_AVERAGE){
+		printf_P(PSTR("\n\r"));
+		return;
+	}
+	
+	//The filters sample 2^filterShift times for each output
+	printf_P(PSTR("Set the samples per output. Press [i] to increase and [d] to decrease. Press [x] to continue\n\r"));
+	printf_P(PSTR("Samples Per Output: %4d\r"), 1 << newSettings->filterShift);
+	tempValue = uartGetChar();
+	while(tolower(tempValue) != 'x'){
+		if((tempValue=='i') && (newSettings->filterShift < FILTER_MAX_SHIFT))newSettings->filterShift++;
+		if((tempValue=='d') && (newSettings->filterShift > 0))newSettings->filterShift--;
+		printf_P(PSTR("Samples Per Output: %4d\r"), 1 << newSettings->filterShift);
+		tempValue = uartGetChar();
+	}
+	printf_P(PSTR("\n\r"));
+	if(!FILTER_IS_IIR(newSettings->filter)){
+		printf_P(PSTR("\n\r"));
+		return;
+	}
+	
+	printf_P(PSTR("Set the cutoff frequency. Press [i] to increase and [d] to decrease.\n\rPress [I] and [D] to change it by 10. Press [x] to exit\n\r"));
+	printf_P(PSTR("The cutoff is kept below half the output frequency while measuring\n\r"));
+	printf_P(PSTR("Cutoff Frequency: %4u\r"), newSettings->filterCutoff);
+	tempValue = uartGetChar();
+	while(tolower(tempValue) != 'x'){
+		if(tempValue=='i')newSettings->filterCutoff += 1;
+		if(tempValue=='I')newSettings->filterCutoff += 10;
+		if((tempValue=='d') && (newSettings->filterCutoff > 1))newSettings->filterCutoff -= 1;
+		if(tempValue=='D')newSettings->filterCutoff = (newSettings->filterCutoff > 10) ? newSettings->filterCutoff - 10 : 1;
+		if(newSettings->filterCutoff > MAX_FILTER_CUTOFF)newSettings->filterCutoff = MAX_FILTER_CUTOFF;
+		printf_P(PSTR("Cutoff Frequency: %4u\r"), newSettings->filterCutoff);
+		tempValue = uartGetChar();
+	}
+	printf_P(PSTR("\n\n\r"));
+}
+
+//Description: Prints the filter setting, i.e. "2nd Order IIR, 16 Samples, 10 Hz"
+void printFilter(struct settings* filterSettings){
+	switch(filterSettings->filter){
+		case FILTER_CIC2: printf_P(PSTR("2nd Order CIC"));
+			break;
+		case FILTER_CIC3: printf_P(PSTR("3rd Order CIC"));
+			break;
+		case FILTER_IIR1: printf_P(PSTR("1st Order IIR"));
+			break;
+		case FILTER_IIR2: printf_P(PSTR("2nd Order IIR"));
+			break;
+		default: printf_P(PSTR("Average"));
+			return;
+	}
+	printf_P(PSTR(", %d Samples"), 1 << filterSettings->filterShift);
+	if(FILTER_IS_IIR(filterSettings->filter))printf_P(PSTR(", %u Hz"), filterSettings->filterCutoff);
+}
+
+void selectTrigger(struct settings* newSettings){
+	char tempValue=0;
+	unsigned char channels[3];
+	//The sample counts are limited by the history left for the enabled axis
+	int capacity = TRIGGER_BUFFER_SIZE / enabledAxes(newSettings->axisMask, channels);
+	
+	printf_P(PSTR("Select the trigger. When it is on, measurement mode only sends the samples around each event\n\r"));
+	printf_P(PSTR("(at the output frequency, without averaging or filtering) instead of streaming.\n\r"));
+	printf_P(PSTR("[1] Off\n\r"));
+	printf_P(PSTR("[2] Any Axis Over the Threshold\n\r"));
+	printf_P(PSTR("[3] Vector Magnitude Over the Threshold\n\r"));
+	
+	tempValue = uartGetChar();
+	if(tempValue >= '1' && tempValue < '1' + NUM_TRIGGER_MODES)newSettings->triggerMode = tempValue-'1';
+	else{
+		printf_P(PSTR("Invalid Selection!\n\n\r"));
+		return;
+	}
+	if(newSettings->triggerMode == TRIGGER_OFF){
+		printf_P(PSTR("\n\r"));
+		return;
+	}
+	
+	printf_P(PSTR("Set the threshold. It includes gravity, so keep it over 1g for an axis that points up.\n\r"));
+	printf_P(PSTR("Press [i] to increase and [d] to decrease by 0.01g. Press [I] and [D] to change it by 0.10g. Press [x] to continue\n\r"));
+	printf_P(PSTR("Threshold: %2d.%02dg\r"), newSettings->triggerThreshold / 100, newSettings->triggerThreshold % 100);
+	tempValue = uartGetChar();
+	while(tolower(tempValue) != 'x'){
+		if(tempValue=='i')newSettings->triggerThreshold += 1;
+		if(tempValue=='I')newSettings->triggerThreshold += 10;
+		if(tempValue=='d')newSettings->triggerThreshold -= 1;
+		if(tempValue=='D')newSettings->triggerThreshold -= 10;
+		if(newSettings->triggerThreshold > MAX_TRIGGER_THRESHOLD)newSettings->triggerThreshold = MAX_TRIGGER_THRESHOLD;
+		if(newSettings->triggerThreshold < 1)newSettings->triggerThreshold = 1;
+		printf_P(PSTR("Threshold: %2d.%02dg\r"), newSettings->triggerThreshold / 100, newSettings->triggerThreshold % 100);
+		tempValue = uartGetChar();
+	}
+	printf_P(PSTR("\n\n\r"));
+	
+	if(newSettings->triggerPost > capacity)newSettings->triggerPost = capacity;
+	if(newSettings->triggerPre > capacity - newSettings->triggerPost)newSettings->triggerPre = capacity - newSettings->triggerPost;
+	printf_P(PSTR("Set the samples before and after the trigger (%d at most for these axes). Press [i] and [d] to change the samples\n\r"), capacity);
+	printf_P(PSTR("before the trigger, and [I] and [D] to change the samples after it. Press [x] to exit\n\r"));
+	printf_P(PSTR("Samples: %3d + %3d\r"), newSettings->triggerPre, newSettings->triggerPost);
+	tempValue = uartGetChar();
+	while(tolower(tempValue) != 'x'){
+		if((tempValue=='i') && (newSettings->triggerPre + newSettings->triggerPost < capacity))newSettings->triggerPre += 1;
+		if((tempValue=='I') && (newSettings->triggerPre + newSettings->triggerPost < capacity))newSettings->triggerPost += 1;
+		if((tempValue=='d') && (newSettings->triggerPre > 0))newSettings->triggerPre -= 1;
+		if((tempValue=='D') && (newSettings->triggerPost > 1))newSettings->triggerPost -= 1;
+		printf_P(PSTR("Samples: %3d + %3d\r"), newSettings->triggerPre, newSettings->triggerPost);
+		tempValue = uartGetChar();
+	}
+	printf_P(PSTR("\n\n\r"));
+}
+
+//Description: Prints the trigger setting, i.e. "Magnitude Over 2.00g, 16 + 48 Samples"
+void printTrigger(struct settings* triggerSettings){
+	switch(triggerSettings->triggerMode){
+		case TRIGGER_AXIS: printf_P(PSTR("Any Axis"));
+			break;
+		case TRIGGER_MAGNITUDE: printf_P(PSTR("Magnitude"));
+			break;
+		default: printf_P(PSTR("Off"));
+			return;
+	}
+	printf_P(PSTR(" Over %d.%02dg, %d + %d Samples"), triggerSettings->triggerThreshold / 100, triggerSettings->triggerThreshold % 100, triggerSettings->triggerPre, triggerSettings->triggerPost);
+}
+
+//Description: Returns the highest output frequency allowed for the given settings (see throughputLimit)
+unsigned int maxOutputFrequency(struct settings* limitSettings){
+	char windowShift = limitSettings->averageShift;
+	unsigned long conversionRate = adcConversionRate(limitSettings->adcClock);
+	unsigned char channels[3];
+	
+	if(limitSettings->filter != FILTER_AVERAGE)windowShift = limitSettings->filterShift;
+	else if(limitSettings->extraResolution != 0)windowShift = limitSettings->extraResolution * 2;
+	if(limitSettings->triggerMode != TRIGGER_OFF){
+		//Events are sent between the samples instead of keeping up with them, so only the ADC and the threshold check
+		//in the main loop limit the sample rate
+		conversionRate = usableConversionRate(conversionRate, TRIGGER_CYCLES, limitSettings->adcDiscard);
+		return adcLimit(conversionRate, 0, enabledAxes(limitSettings->axisMask, channels));
+	}
+	//The filters run in the main loop for every value converted, which leaves less time for the interrupt
+	conversionRate = usableConversionRate(conversionRate, filterCycles(limitSettings->filter), limitSettings->adcDiscard);
+	return throughputLimit(limitSettings->outputMode, limitSettings->burstSize, enabledAxes(limitSettings->axisMask, channels), baudRateSettings[limitSettings->baudRate], windowShift, conversionRate);
+}
+
+//Description: Lists the ADC channels of the axis enabled in an axis mask, in axisScanOrder
+//Parameters: axisMask - bit n is set if the axis on ADC channel n is enabled (see AXIS_MASK_ALL)
+//			  channels - filled in with the enabled channels (3 bytes)
+//Returns: The number of enabled axis
+//Usage: axisCount = enabledAxes(mySettings.axisMask, axisChannel);
+unsigned char enabledAxes(int axisMask, unsigned char* channels){
+	unsigned char count = 0;
+	
+	for(char axis=0; axis < 3; axis++){
+		if(axisMask & (1 << axisScanOrder[(int)axis]))channels[count++] = axisScanOrder[(int)axis];
+	}
+	return count;
+}
+
+//Description: Prints the names of the axis enabled in an axis mask, i.e. "X Z"
+void printAxes(int axisMask){
+	const char axisNames[3] = {'X', 'Y', 'Z'};
+	char separator = 0;
+	
+	for(char axis=0; axis < 3; axis++){
+		if(!(axisMask & (1 << axisScanOrder[(int)axis])))continue;
+		if(separator)putchar(separator);
+		putchar(axisNames[(int)axis]);
+		separator = ' ';
+	}
+}
+
+//Description: Empties the ADC interrupt's running average and sets the window size. Must be called while the ADC is stopped.
+//Parameters: windowShift - the window is 2^windowShift samples (0 to MAX_AVERAGE_SHIFT)
+void startAveraging(char windowShift){
+	for(char axis=0; axis < 3; axis++){
+		adcSum[(int)axis] = 0;
+		for(char reading=0; reading < MAX_AVERAGE_WINDOW; reading++)adcHistory[(int)axis][(int)reading] = 0;
+	}
+	historyIndex = 0;
+	averageMask = (1 << windowShift) - 1;
+}
+
+//Description: Stores a 16 bit value in a byte buffer, most significant byte first
+void putBigEndian(unsigned char* buffer, unsigned int value){
+	buffer[0] = value >> 8;
+	buffer[1] = value;
+}
+
+//Description: Stores a 32 bit value in a byte buffer, most significant byte first
+void putBigEndianLong(unsigned char* buffer, unsigned long value){
+	putBigEndian(&buffer[0], value >> 16);
+	putBigEndian(&buffer[2], value);
+}
+
+//Description: Reads a 16 bit value from a byte buffer, most significant byte first
+unsigned int getBigEndian(const unsigned char* buffer){
+	return ((unsigned int)buffer[0] << 8) | buffer[1];
+}
+
+//Description: Reads a 32 bit value from a byte buffer, most significant byte first
+unsigned long getBigEndianLong(const unsigned char* buffer){
+	return ((unsigned long)getBigEndian(&buffer[0]) << 16) | getBigEndian(&buffer[2]);
+}
+
+//Description: Sends a frame stamped with the current time and counts it in the performance counters.
+// A frame that doesn't fit in the UART transmit buffer is dropped, but its sequence number is still used so the host can count the loss.
+//Usage: outputFrame(FRAME_TYPE_SAMPLE, frameSequence++, framePayload, 6);
+void outputFrame(unsigned char type, unsigned int sequence, const unsigned char* payload, unsigned char length){
+	if(frameSend(type, sequence, millis(), payload, length))performance.framesSent++;
+	else performance.framesDropped++;
+}
+
+//Description: Sets all of the performance counters (including the UART statistics) back to 0
+void clearPerformanceCounters(void){
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+		memset((void*)&performance, 0, sizeof(performance));
+		uartTxHighWater = 0;
+		uartTxOverflows = 0;
+		uartRxOverflows = 0;
+		uartRxOverruns = 0;
+	}
+}
+
+//Description: Fills in the payload of a FRAME_TYPE_STATUS frame (see frame.h)
+//Parameters: buffer - at least STATUS_PAYLOAD_SIZE bytes
+//Returns: The payload length
+unsigned char statusPayload(unsigned char* buffer){
+	struct performanceCounters counters;
+	unsigned int txOverflows, rxOverflows, rxOverruns;
+	
+	//The interrupts update the counters (the 16 and 32 bit ones take several reads), so take a consistent copy
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+		memcpy(&counters, (void*)&performance, sizeof(counters));
+		txOverflows = uartTxOverflows;
+		rxOverflows = uartRxOverflows;
+		rxOverruns = uartRxOverruns;
+	}
+	putBigEndianLong(&buffer[0], counters.adcConversions);
+	putBigEndianLong(&buffer[4], counters.framesSent);
+	putBigEndian(&buffer[8], counters.framesDropped);
+	putBigEndian(&buffer[10], counters.samplesDropped);
+	putBigEndian(&buffer[12], uartTxHighWater);
+	putBigEndian(&buffer[14], txOverflows);
+	putBigEndian(&buffer[16], rxOverflows);
+	putBigEndian(&buffer[18], rxOverruns);
+	putBigEndian(&buffer[20], counters.maxLoopTicks);
+	putBigEndianLong(&buffer[22], counters.isrTicks);
+	//Timer 1 TOP, the period is one tick more (which wouldn't fit in 16 bits when TOP is 0xFFFF)
+	putBigEndian(&buffer[26], OCR1A);
+	
+	return STATUS_PAYLOAD_SIZE;
+}
+
+//Description: Prints the performance counters from the last measurement run
+void showDiagnostics(void){
+	struct performanceCounters counters;
+	unsigned int txOverflows, rxOverflows, rxOverruns;
+	unsigned long busy, total;
+	
+	//Take a consistent copy of the counters the interrupts update
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+		memcpy(&counters, (void*)&performance, sizeof(counters));
+		txOverflows = uartTxOverflows;
+		rxOverflows = uartRxOverflows;
+		rxOverruns = uartRxOverruns;
+	}
+	busy = counters.isrTicks;
+	total = counters.adcConversions * (OCR1A + 1UL);
+	
+	printf_P(PSTR("Diagnostics for the last measurement run (cleared when it starts, or by sending '%c')\n\r"), STATUS_CLEAR);
+	printf_P(PSTR("ADC Conversions:\t%lu\n\r"), counters.adcConversions);
+	printf_P(PSTR("Frames Sent:\t\t%lu\n\r"), counters.framesSent);
+	printf_P(PSTR("Frames Dropped:\t\t%u\n\r"), counters.framesDropped);
+	printf_P(PSTR("Samples Dropped:\t%u\n\r"), counters.samplesDropped);
+	printf_P(PSTR("TX Buffer High Water:\t%u of %u bytes\n\r"), counters.txHighWater, UART_TX_BUFFER_SIZE - 1);
+	printf_P(PSTR("TX Overflows:\t\t%u\n\r"), txOverflows);
+	printf_P(PSTR("RX Overflows:\t\t%u\n\r"), rxOverflows);
+	printf_P(PSTR("RX Overruns:\t\t%u\n\r"), rxOverruns);
+	printf_P(PSTR("Longest Loop:\t\t%lu us\n\r"), (counters.maxLoopTicks * TIMER2_US_PER_TICK_Q8) >> 8);
+	//Scale both totals down so the percentage can be worked out without overflowing
+	while(total > 0xFFFFFUL){
+		total >>= 1;
+		busy >>= 1;
+	}
+	if(total != 0)printf_P(PSTR("ISR Load:\t\t%lu.%lu%%\n\r"), (busy * 1000 / total) / 10, (busy * 1000 / total) % 10);
+	printf_P(PSTR("\n\r"));
+}
+
+//Description: Fills in the settings sent in FRAME_TYPE_REPLY frames (see COMMAND_GET_SETTINGS in command.h)
+//Parameters: buffer - at least SETTINGS_PAYLOAD_SIZE bytes
+//			  measuring - true if measurement mode is running
+//Returns: The payload length
+unsigned char settingsPayload(unsigned char* buffer, struct settings* payloadSettings, bool measuring){
+	buffer[0] = RANGE_INDEX(payloadSettings->accelerometerRange);
+	buffer[1] = payloadSettings->outputMode;
+	putBigEndian(&buffer[2], payloadSettings->outputFrequency);
+	buffer[4] = payloadSettings->baudRate;
+	buffer[5] = payloadSettings->averageShift;
+	buffer[6] = payloadSettings->extraResolution;
+	buffer[7] = payloadSettings->burstSize;
+	buffer[8] = payloadSettings->adcClock;
+	buffer[9] = payloadSettings->adcDiscard;
+	buffer[10] = payloadSettings->axisMask;
+	buffer[11] = measuring;
+	putBigEndian(&buffer[12], maxOutputFrequency(payloadSettings));
+	buffer[14] = payloadSettings->filter;
+	buffer[15] = payloadSettings->filterShift;
+	putBigEndian(&buffer[16], payloadSettings->filterCutoff);
+	buffer[18] = payloadSettings->triggerMode;
+	putBigEndian(&buffer[19], payloadSettings->triggerThreshold);
+	buffer[21] = payloadSettings->triggerPre;
+	buffer[22] = payloadSettings->triggerPost;
+	
+	return SETTINGS_PAYLOAD_SIZE;
+}
+
+//Description: Reads the rest of a binary command that arrived while the menu was waiting for a selection
+//Parameters: parser - receives the command
+//			  firstByte - the byte that was read as the menu selection (FRAME_SYNC1)
+//Returns: true if a complete command arrived, false if it failed its CRC check or stopped for COMMAND_TIMEOUT_MS
+bool receiveCommand(struct commandParser* parser, char firstByte){
+	int data;
+	
+	commandReset(parser);
+	commandParse(parser, firstByte, millis());
+	while(commandPending(parser, millis())){
+		data = uartReadChar();
+		if((data >= 0) && commandParse(parser, data, millis()))return true;
+	}
+	return false;
+}
+
+//Description: Carries out a binary command (see command.h) and builds its FRAME_TYPE_REPLY payload.
+// New values are checked the same way the menus check them, and the output frequency is lowered if the new settings can't keep up with it.
+// Changes that need the hardware or measurement mode to be set up again are left to main (see COMMAND_ACTION_SETUP).
+//Parameters: command - the command from commandParse
+//			  commandSettings - the settings to change. Nothing is changed if the command is refused.
+//			  measuring - true if measurement mode is running
+//			  reply - at least REPLY_PAYLOAD_SIZE bytes, filled in with the reply payload
+//			  replyLength - set to the length of the reply payload
+//Returns: The COMMAND_ACTION_... flags for what main has to do
+//Usage: commandActions = runCommand(&commandIn, &commandSettings, true, replyFrame, &replyLength);
+unsigned char runCommand(struct commandParser* command, struct settings* commandSettings, bool measuring, unsigned char* reply, unsigned char* replyLength){
+	struct settings newSettings = *commandSettings;
+	unsigned char value = command->payload[0], length, actions = 0, result = COMMAND_RESULT_OK;
+	unsigned int rate;
+	unsigned int ubrr;
+	char doubleSpeed;
+	unsigned char channels[3];
+	
+	reply[0] = command->command;
+	//Payload length of each command
+	switch(command->command){
+		case COMMAND_SET_RATE:
+			length = 2;
+			break;
+		case COMMAND_SET_MODE:
+		case COMMAND_SET_RANGE:
+		case COMMAND_SET_BAUD:
+		case COMMAND_SET_AXES:
+			length = 1;
+			break;
+		case COMMAND_SET_FILTER:
+			length = 4;
+			break;
+		case COMMAND_SET_TRIGGER:
+			length = 5;
+			break;
+		case COMMAND_GET_SETTINGS:
+		case COMMAND_START:
+		case COMMAND_STOP:
+		case COMMAND_GET_STATUS:
+		case COMMAND_CLEAR_STATUS:
+		case COMMAND_SAVE:
+			length = 0;
+			break;
+		default:
+			reply[1] = COMMAND_RESULT_UNKNOWN;
+			*replyLength = 2;
+			return 0;
+	}
+	
+	if(command->length != length)result = COMMAND_RESULT_BAD_LENGTH;
+	else switch(command->command){
+		case COMMAND_SET_RATE:
+			rate = getBigEndian(command->payload);
+			if((rate < 1) || (rate > maxOutputFrequency(&newSettings)))result = COMMAND_RESULT_BAD_VALUE;
+			else newSettings.outputFrequency = rate;
+			break;
+		case COMMAND_SET_MODE:
+			if(value >= NUM_OUTPUT_MODES)result = COMMAND_RESULT_BAD_VALUE;
+			else newSettings.outputMode = value;
+			break;
+		case COMMAND_SET_RANGE:
+			if(value >= NUM_RANGES)result = COMMAND_RESULT_BAD_VALUE;
+			else newSettings.accelerometerRange = rangeSettings[value];
+			break;
+		case COMMAND_SET_BAUD:
+			//Don't switch to a baud rate the UART can't make accurately at this clock speed
+			if((value >= NUM_BAUD_RATES) || (uartBaudSetting(baudRateSettings[value], &ubrr, &doubleSpeed) > UART_MAX_BAUD_ERROR))result = COMMAND_RESULT_BAD_VALUE;
+			else newSettings.baudRate = value;
+			break;
+		case COMMAND_SET_AXES:
+			if((value == 0) || (value & ~AXIS_MASK_ALL))result = COMMAND_RESULT_BAD_VALUE;
+			else newSettings.axisMask = value;
+			break;
+		case COMMAND_SET_FILTER:
+			rate = getBigEndian(&command->payload[2]);
+			if((value >= NUM_FILTERS) || (command->payload[1] > FILTER_MAX_SHIFT) || (rate < 1) || (rate > MAX_FILTER_CUTOFF))result = COMMAND_RESULT_BAD_VALUE;
+			else{
+				newSettings.filter = value;
+				newSettings.filterShift = command->payload[1];
+				newSettings.filterCutoff = rate;
+			}
+			break;
+		case COMMAND_SET_TRIGGER:
+			rate = getBigEndian(&command->payload[1]);
+			//The history holds fewer samples when more axis are enabled (see triggerInit)
+			if((value >= NUM_TRIGGER_MODES) || (rate < 1) || (rate > MAX_TRIGGER_THRESHOLD) || (command->payload[4] < 1) ||
+				(command->payload[3] + command->payload[4] > TRIGGER_BUFFER_SIZE / enabledAxes(newSettings.axisMask, channels)))result = COMMAND_RESULT_BAD_VALUE;
+			else{
+				newSettings.triggerMode = value;
+				newSettings.triggerThreshold = rate;
+				newSettings.triggerPre = command->payload[3];
+				newSettings.triggerPost = command->payload[4];
+			}
+			break;
+		case COMMAND_START:
+			if(!measuring)actions |= COMMAND_ACTION_START;
+			break;
+		case COMMAND_STOP:
+			if(measuring)actions |= COMMAND_ACTION_STOP;
+			break;
+		case COMMAND_GET_STATUS:
+			reply[1] = COMMAND_RESULT_OK;
+			*replyLength = 2 + statusPayload(&reply[2]);
+			return 0;
+		case COMMAND_CLEAR_STATUS:
+			clearPerformanceCounters();
+			break;
+		case COMMAND_SAVE:
+			saveSettings(&newSettings);
+			break;
+	}
+	
+	if(result == COMMAND_RESULT_OK){
+		if(newSettings.outputFrequency > maxOutputFrequency(&newSettings))newSettings.outputFrequency = maxOutputFrequency(&newSettings);
+		if((newSettings.outputFrequency != commandSettings->outputFrequency) || (newSettings.outputMode != commandSettings->outputMode) ||
+			(newSettings.baudRate != commandSettings->baudRate) || (newSettings.axisMask != commandSettings->axisMask) ||
+			(newSettings.filter != commandSettings->filter) || (newSettings.filterShift != commandSettings->filterShift) ||
+			(newSettings.filterCutoff != commandSettings->filterCutoff) || (newSettings.triggerMode != commandSettings->triggerMode) ||
+			(newSettings.triggerThreshold != commandSettings->triggerThreshold) || (newSettings.triggerPre != commandSettings->triggerPre) ||
+			(newSettings.triggerPost != commandSettings->triggerPost))actions |= COMMAND_ACTION_SETUP;
+		if(newSettings.accelerometerRange != commandSettings->accelerometerRange)actions |= COMMAND_ACTION_RANGE;
+		*commandSettings = newSettings;
+	}
+	
+	reply[1] = result;
+	if(actions & COMMAND_ACTION_START)measuring = true;
+	if(actions & COMMAND_ACTION_STOP)measuring = false;
+	*replyLength = 2 + settingsPayload(&reply[2], commandSettings, measuring);
+	return actions;
+}
+
+//Description: Packs big endian 16 bit values down to 10 bits per value, as a continuous big endian bit stream.
+// The packing is done in place: the packed data is never longer than the data still to be read, so it can't overwrite it.
+//Parameters: buffer - holds the samples as 16 bit values, one for each enabled axis in turn
+//			  values - the number of values in the buffer (samples * enabled axis)
+//			  shift - each value is shifted right this many bits (to drop extra oversampling bits), then the lower 10 bits are kept
+//Returns: The number of packed bytes (10 bits per value, rounded up to a whole byte)
+//Usage: length = packSamples(framePayload, 4 * 3, 0);	//4 samples of 3 axis pack into 15 bytes
+unsigned char packSamples(unsigned char* buffer, unsigned char values, char shift)
+{
+	unsigned char* input = buffer;
+	unsigned char* output = buffer;
+	unsigned long bits = 0;
+	char bitCount = 0;
+	
+	while(values--){
+		bits = (bits << 10) | ((((unsigned int)input[0] << 8 | input[1]) >> shift) & 0x3FF);
+		input += 2;
+		bitCount += 10;
+		while(bitCount >= 8){
+			bitCount -= 8;
+			*output++ = bits >> bitCount;
+		}
+	}
+	//Pad the last partial byte with 0 bits
+	if(bitCount > 0)*output++ = bits << (8 - bitCount);
+	
+	return output - buffer;
 }
 
 void setAccelerometerRange(int range){
@@ -573,44 +1717,158 @@ void setAccelerometerRange(int range){
 
 void loadSettings(struct settings* newSettings)
 {
-	newSettings->accelerometerRange = eepromReadInt(EEPROM_SETTINGS_ADDRESS);
-	newSettings->outputMode = eepromReadInt(EEPROM_SETTINGS_ADDRESS + 2);
-	newSettings->outputFrequency = eepromReadInt(EEPROM_SETTINGS_ADDRESS + 4);
-	newSettings->baudRate = eepromReadInt(EEPROM_SETTINGS_ADDRESS + 6);
+	unsigned char block[EEPROM_SETTINGS_SIZE];
+	
+	eepromReadBlock(EEPROM_SETTINGS_ADDRESS, block, EEPROM_SETTINGS_SIZE);
+	newSettings->accelerometerRange = getBigEndian(&block[0]);
+	newSettings->outputMode = getBigEndian(&block[2]);
+	newSettings->outputFrequency = getBigEndian(&block[4]);
+	newSettings->baudRate = getBigEndian(&block[6]);
+	if(newSettings->baudRate >= NUM_BAUD_RATES)newSettings->baudRate = BAUD_38400;
+	
+	//These options may never have been written by older firmware, so use the defaults if they are out of range
+	newSettings->averageShift = eepromReadChar(EEPROM_AVERAGE_SHIFT);
+	if(newSettings->averageShift > MAX_AVERAGE_SHIFT)newSettings->averageShift = DEFAULT_AVERAGE_SHIFT;
+	newSettings->extraResolution = eepromReadChar(EEPROM_EXTRA_RESOLUTION);
+	if(newSettings->extraResolution > MAX_EXTRA_RESOLUTION)newSettings->extraResolution = 0;
+	newSettings->burstSize = eepromReadChar(EEPROM_BURST_SIZE);
+	if((newSettings->burstSize < 1) || (newSettings->burstSize > MAX_BURST_SIZE))newSettings->burstSize = DEFAULT_BURST_SIZE;
+	newSettings->adcClock = eepromReadChar(EEPROM_ADC_CLOCK);
+	if(newSettings->adcClock >= NUM_ADC_CLOCKS)newSettings->adcClock = ADC_CLOCK_STANDARD;
+	newSettings->adcDiscard = eepromReadChar(EEPROM_ADC_DISCARD);
+	if(newSettings->adcDiscard > 1)newSettings->adcDiscard = 0;
+	newSettings->axisMask = eepromReadChar(EEPROM_AXIS_MASK);
+	if((newSettings->axisMask == 0) || (newSettings->axisMask > AXIS_MASK_ALL))newSettings->axisMask = AXIS_MASK_ALL;
+	newSettings->filter = eepromReadChar(EEPROM_FILTER);
+	if(newSettings->filter >= NUM_FILTERS)newSettings->filter = FILTER_AVERAGE;
+	newSettings->filterShift = eepromReadChar(EEPROM_FILTER_SHIFT);
+	if(newSettings->filterShift > FILTER_MAX_SHIFT)newSettings->filterShift = DEFAULT_FILTER_SHIFT;
+	newSettings->filterCutoff = eepromReadInt(EEPROM_FILTER_CUTOFF);
+	if((newSettings->filterCutoff < 1) || (newSettings->filterCutoff > MAX_FILTER_CUTOFF))newSettings->filterCutoff = DEFAULT_FILTER_CUTOFF;
+	newSettings->triggerMode = eepromReadChar(EEPROM_TRIGGER_MODE);
+	if(newSettings->triggerMode >= NUM_TRIGGER_MODES)newSettings->triggerMode = TRIGGER_OFF;
+	newSettings->triggerThreshold = eepromReadInt(EEPROM_TRIGGER_THRESHOLD);
+	if((newSettings->triggerThreshold < 1) || (newSettings->triggerThreshold > MAX_TRIGGER_THRESHOLD))newSettings->triggerThreshold = DEFAULT_TRIGGER_THRESHOLD;
+	newSettings->triggerPre = eepromReadChar(EEPROM_TRIGGER_PRE);
+	newSettings->triggerPost = eepromReadChar(EEPROM_TRIGGER_POST);
+	if((newSettings->triggerPost < 1) || (newSettings->triggerPre + newSettings->triggerPost > TRIGGER_BUFFER_SIZE)){
+		newSettings->triggerPre = DEFAULT_TRIGGER_PRE;
+		newSettings->triggerPost = DEFAULT_TRIGGER_POST;
+	}
 }
 
-void loadCalibration(struct sensorReadings* calibrationValues)
+void loadCalibration(unsigned char range, struct sensorReadings* calibrationValues)
 {
-	calibrationValues->x = eepromReadLong(EEPROM_CALIBRATION_ADDRESS);
-	calibrationValues->y = eepromReadLong(EEPROM_CALIBRATION_ADDRESS + 4);
-	calibrationValues->z = eepromReadLong(EEPROM_CALIBRATION_ADDRESS + 8);
+	unsigned char block[EEPROM_CALIBRATION_SIZE];
+	
+	eepromReadBlock(EEPROM_CALIBRATION_FOR(range), block, EEPROM_CALIBRATION_SIZE);
+	calibrationValues->x = getBigEndianLong(&block[0]);
+	calibrationValues->y = getBigEndianLong(&block[4]);
+	calibrationValues->z = getBigEndianLong(&block[8]);
 }
 
-void loadSwing(struct sensorReadings* swingValues)
+void loadSwing(unsigned char range, struct sensorReadings* swingValues)
 {
-	swingValues->x = eepromReadLong(EEPROM_SWING_ADDRESS);
-	swingValues->y = eepromReadLong(EEPROM_SWING_ADDRESS + 4);
-	swingValues->z = eepromReadLong(EEPROM_SWING_ADDRESS + 8);
+	unsigned char block[EEPROM_SWING_SIZE];
+	
+	eepromReadBlock(EEPROM_SWING_FOR(range), block, EEPROM_SWING_SIZE);
+	swingValues->x = getBigEndianLong(&block[0]);
+	swingValues->y = getBigEndianLong(&block[4]);
+	swingValues->z = getBigEndianLong(&block[8]);
 }
 
+//Description: Sets a range's calibration and swing values to the MMA7361 datasheet values
+//Parameters: range - RANGE_INDEX_15 or RANGE_INDEX_60
+void defaultCalibration(unsigned char range, struct sensorReadings* calibrationValues, struct sensorReadings* swingValues)
+{
+	calibrationValues->x = 1650;
+	calibrationValues->y = 1650;
+	calibrationValues->z = 1650;
+	swingValues->x = rangeSettings[range];
+	swingValues->y = rangeSettings[range];
+	swingValues->z = rangeSettings[range];
+}
+
+//Description: Returns true if calibration and swing values are usable (i.e. not erased EEPROM)
+bool validCalibration(struct sensorReadings* calibrationValues, struct sensorReadings* swingValues)
+{
+	unsigned long *calibration = &calibrationValues->x, *swing = &swingValues->x;
+	
+	for(char axis=0; axis < 3; axis++){
+		if(calibration[(int)axis] > ADC_REFERENCE_MV)return false;
+		if((swing[(int)axis] < MIN_SWING_MV) || (swing[(int)axis] > ADC_REFERENCE_MV))return false;
+	}
+	return true;
+}
+
+//Description: Loads the calibration and swing values of both ranges. A range that has never been calibrated gets the datasheet values.
+// Older firmware only had one set of values, for whichever range was selected, and it is stored where the 1.5g set is now.
+// If the board was left on the 6g range, those values are moved over to the 6g set.
+//Parameters: loadedSettings - the settings, already loaded
+//			  calibrationValues, swingValues - arrays of NUM_RANGES, indexed by RANGE_INDEX
+void loadRangeCalibration(struct settings* loadedSettings, struct sensorReadings* calibrationValues, struct sensorReadings* swingValues)
+{
+	unsigned char range;
+	
+	for(range=0; range < NUM_RANGES; range++){
+		loadCalibration(range, &calibrationValues[range]);
+		loadSwing(range, &swingValues[range]);
+	}
+	if(!validCalibration(&calibrationValues[RANGE_INDEX_60], &swingValues[RANGE_INDEX_60]) && (loadedSettings->accelerometerRange == RANGE_60)){
+		calibrationValues[RANGE_INDEX_60] = calibrationValues[RANGE_INDEX_15];
+		swingValues[RANGE_INDEX_60] = swingValues[RANGE_INDEX_15];
+		defaultCalibration(RANGE_INDEX_15, &calibrationValues[RANGE_INDEX_15], &swingValues[RANGE_INDEX_15]);
+		for(range=0; range < NUM_RANGES; range++){
+			saveCalibration(range, &calibrationValues[range]);
+			saveSwing(range, &swingValues[range]);
+		}
+	}
+	for(range=0; range < NUM_RANGES; range++){
+		if(!validCalibration(&calibrationValues[range], &swingValues[range]))defaultCalibration(range, &calibrationValues[range], &swingValues[range]);
+	}
+}
+
+//Description: Queues the settings to be written to EEPROM. Only the bytes that changed are written (see eepromWriteChar).
 void saveSettings(struct settings* saveSetting)
 {
-	eepromWriteInt(EEPROM_SETTINGS_ADDRESS, saveSetting->accelerometerRange);
-	eepromWriteInt(EEPROM_SETTINGS_ADDRESS+2, saveSetting->outputMode);
-	eepromWriteInt(EEPROM_SETTINGS_ADDRESS+4, saveSetting->outputFrequency);
-	eepromWriteInt(EEPROM_SETTINGS_ADDRESS+6, saveSetting->baudRate);
+	unsigned char block[EEPROM_SETTINGS_SIZE];
+	
+	putBigEndian(&block[0], saveSetting->accelerometerRange);
+	putBigEndian(&block[2], saveSetting->outputMode);
+	putBigEndian(&block[4], saveSetting->outputFrequency);
+	putBigEndian(&block[6], saveSetting->baudRate);
+	eepromWriteBlock(EEPROM_SETTINGS_ADDRESS, block, EEPROM_SETTINGS_SIZE);
+	eepromWriteChar(EEPROM_AVERAGE_SHIFT, saveSetting->averageShift);
+	eepromWriteChar(EEPROM_EXTRA_RESOLUTION, saveSetting->extraResolution);
+	eepromWriteChar(EEPROM_BURST_SIZE, saveSetting->burstSize);
+	eepromWriteChar(EEPROM_ADC_CLOCK, saveSetting->adcClock);
+	eepromWriteChar(EEPROM_ADC_DISCARD, saveSetting->adcDiscard);
+	eepromWriteChar(EEPROM_AXIS_MASK, saveSetting->axisMask);
+	eepromWriteChar(EEPROM_FILTER, saveSetting->filter);
+	eepromWriteChar(EEPROM_FILTER_SHIFT, saveSetting->filterShift);
+	eepromWriteInt(EEPROM_FILTER_CUTOFF, saveSetting->filterCutoff);
+	eepromWriteChar(EEPROM_TRIGGER_MODE, saveSetting->triggerMode);
+	eepromWriteInt(EEPROM_TRIGGER_THRESHOLD, saveSetting->triggerThreshold);
+	eepromWriteChar(EEPROM_TRIGGER_PRE, saveSetting->triggerPre);
+	eepromWriteChar(EEPROM_TRIGGER_POST, saveSetting->triggerPost);
 }
 
-void saveCalibration(struct sensorReadings* calibrationValues)
+void saveCalibration(unsigned char range, struct sensorReadings* calibrationValues)
 {
-	eepromWriteLong(EEPROM_CALIBRATION_ADDRESS, calibrationValues->x);
-	eepromWriteLong(EEPROM_CALIBRATION_ADDRESS + 4, calibrationValues->y);
-	eepromWriteLong(EEPROM_CALIBRATION_ADDRESS + 8, calibrationValues->z);
+	unsigned char block[EEPROM_CALIBRATION_SIZE];
+	
+	putBigEndianLong(&block[0], calibrationValues->x);
+	putBigEndianLong(&block[4], calibrationValues->y);
+	putBigEndianLong(&block[8], calibrationValues->z);
+	eepromWriteBlock(EEPROM_CALIBRATION_FOR(range), block, EEPROM_CALIBRATION_SIZE);
 }
 
-void saveSwing(struct sensorReadings* swingValues)
+void saveSwing(unsigned char range, struct sensorReadings* swingValues)
 {
-	eepromWriteLong(EEPROM_SWING_ADDRESS, swingValues->x);
-	eepromWriteLong(EEPROM_SWING_ADDRESS + 4, swingValues->y);
-	eepromWriteLong(EEPROM_SWING_ADDRESS + 8, swingValues->z);
+	unsigned char block[EEPROM_SWING_SIZE];
+	
+	putBigEndianLong(&block[0], swingValues->x);
+	putBigEndianLong(&block[4], swingValues->y);
+	putBigEndianLong(&block[8], swingValues->z);
+	eepromWriteBlock(EEPROM_SWING_FOR(range), block, EEPROM_SWING_SIZE);
 }
\ No newline at end of file
@@ -7,6 +7,19 @@ struct settings{
 	int outputMode;			//keeps track of the desired output mode for accelerometer data (Gravity, Raw or Binary)
 	int outputFrequency;	//The frequency at which data will be sent to the serial port. Different limits depending on the selected baud rate.
 	unsigned int baudRate;			//The baud rate for serial communications
+	int averageShift;		//Each output value is the average of 2^averageShift samples (0 to MAX_AVERAGE_SHIFT)
+	int extraResolution;	//Bits of resolution added by oversampling (0 to MAX_EXTRA_RESOLUTION). Overrides averageShift when not 0.
+	int burstSize;			//Number of samples packed into each frame in the burst output mode (1 to MAX_BURST_SIZE)
+	int adcClock;			//ADC clock used in measurement mode (ADC_CLOCK_STANDARD, ADC_CLOCK_FAST or ADC_CLOCK_FASTEST)
+	int adcDiscard;			//1 to throw away the first reading after each ADC channel switch
+	int axisMask;			//The axis that are sampled and output. Bit n is set if the axis on ADC channel n is enabled (AXIS_MASK_ALL for all 3).
+	int filter;				//How the samples are reduced to the output frequency (FILTER_AVERAGE, or one of the CIC and IIR filters in filter.h)
+	int filterShift;		//The CIC and IIR filters take 2^filterShift samples for each output (0 to FILTER_MAX_SHIFT). Replaces averageShift.
+	unsigned int filterCutoff;	//Cutoff of the IIR filters in Hz. Limited to half the output frequency when measurement mode starts.
+	int triggerMode;		//TRIGGER_OFF to stream, or how an event is detected (see trigger.h). Events are sampled at the output frequency.
+	int triggerThreshold;	//Trigger level in hundredths of a g (1 to MAX_TRIGGER_THRESHOLD)
+	int triggerPre;			//Samples sent from before the trigger (0 to TRIGGER_BUFFER_SIZE - 1)
+	int triggerPost;		//Samples sent from the trigger on (1 to TRIGGER_BUFFER_SIZE). Both are cut down to fit the history when there are more axis.
 };
 
 //Description: Stores x, y and z unsigned long integer data. Used for ADC counts and the millivolts and the calibration values
@@ -16,31 +29,86 @@ struct sensorReadings{
 	unsigned long int z;
 };
 
-//Descriptions: Used to store x,y and z float data. Used for G Values
-struct sensorValues{
-	double x;
-	double y;
-	double z;
+//Description: One reading of all 3 axis, as published by the ADC interrupt. Indexed by X_AXIS, Y_AXIS and Z_AXIS.
+// axis holds the raw ADC counts, sum holds the running total of the last 2^averageShift counts.
+struct adcSample{
+	unsigned int axis[3];
+	unsigned int sum[3];
+};
+
+//Description: Fixed point (Q16) factors that convert an ADC count straight to hundredths of a g.
+// centi-g = (count * scale - offset) / 65536. Computed from the calibration and swing values by computeGravityScale.
+struct gravityConversion{
+	struct sensorReadings scale;
+	struct sensorReadings offset;
+};
+
+//Description: Counters used to tune the rate, baud rate and output mode combinations. All of them
+// are cleared when measurement mode starts and when STATUS_CLEAR is received (see clearPerformanceCounters).
+// Times are in timer ticks: isrTicks counts timer 1 ticks (one timer 1 period per conversion, so the
+// ISR load is isrTicks / (adcConversions * timer 1 period)), maxLoopTicks counts timer 2 ticks (TIMER2_TICKS_PER_MS).
+struct performanceCounters{
+	unsigned long adcConversions;	//ADC conversions completed (3 per sample)
+	unsigned long framesSent;		//Output lines or frames handed to the UART
+	unsigned int framesDropped;		//Framed output frames that didn't fit in the UART transmit buffer (their sequence numbers are skipped)
+	unsigned int samplesDropped;	//Samples the main loop didn't read before the ADC interrupt overwrote them
+	unsigned int maxLoopTicks;		//Longest main loop pass that handled a sample
+	unsigned long isrTicks;			//Time spent in the ADC and timer 2 interrupts
+	unsigned char txHighWater;		//uartTxHighWater when measurement mode stopped
 };
 
 //=======================================================
 //					Function Definitions
 //=======================================================
+struct commandParser;	//See command.h
 void IOInit(void);
-void selectAccelerometerRange(struct settings* newSettings, struct sensorReadings* swingValues);
+void selectAccelerometerRange(struct settings* newSettings);
 char configMenu(struct settings* menuSettings, struct sensorReadings* menuCalibrationValues);
-void toGValue(struct sensorValues* gValue, struct sensorReadings* voltage, struct sensorReadings* calibration, struct sensorReadings* swing);
+void computeGravityScale(struct gravityConversion* conversion, struct sensorReadings* calibration, struct sensorReadings* swing, char extraBits);
+int countToCentiG(unsigned int count, unsigned long scale, unsigned long offset);
+void printCentiG(int value, char terminator);
+bool getSample(struct adcSample* sample);
 void selectCalibrationValues(struct sensorReadings* newCalibrationValues, struct sensorReadings* swingValues);
+bool captureStillPose(unsigned long* totals);
+char findPose(unsigned long* totals, struct sensorReadings* calibration);
 void selectOutputMode(struct settings* newSettings);
 void selectOutputFrequency(struct settings* newSettings);
 void selectBaudRate(struct settings* newSettings);
+void selectAveraging(struct settings* newSettings);
+void selectResolution(struct settings* newSettings);
+void selectBurstSize(struct settings* newSettings);
+void selectAdcClock(struct settings* newSettings);
+void selectAxes(struct settings* newSettings);
+void selectFilter(struct settings* newSettings);
+unsigned char enabledAxes(int axisMask, unsigned char* channels);
+void printAxes(int axisMask);
+void printFilter(struct settings* filterSettings);
+void selectTrigger(struct settings* newSettings);
+void printTrigger(struct settings* triggerSettings);
+void startAveraging(char windowShift);
+unsigned int maxOutputFrequency(struct settings* limitSettings);
 void setAccelerometerRange(int range);
+void putBigEndian(unsigned char* buffer, unsigned int value);
+unsigned char packSamples(unsigned char* buffer, unsigned char values, char shift);
+void putBigEndianLong(unsigned char* buffer, unsigned long value);
+unsigned int getBigEndian(const unsigned char* buffer);
+unsigned long getBigEndianLong(const unsigned char* buffer);
+void outputFrame(unsigned char type, unsigned int sequence, const unsigned char* payload, unsigned char length);
+void clearPerformanceCounters(void);
+unsigned char statusPayload(unsigned char* buffer);
+void showDiagnostics(void);
+unsigned char settingsPayload(unsigned char* buffer, struct settings* payloadSettings, bool measuring);
+bool receiveCommand(struct commandParser* parser, char firstByte);
+unsigned char runCommand(struct commandParser* command, struct settings* commandSettings, bool measuring, unsigned char* reply, unsigned char* replyLength);
 void loadSettings(struct settings* newSettings);
-void loadCalibration(struct sensorReadings* calibrationValues);
+void loadCalibration(unsigned char range, struct sensorReadings* calibrationValues);
 void saveSettings(struct settings* saveSetting);
-void saveCalibration(struct sensorReadings* calibrationValues);
-void loadSwing(struct sensorReadings* swingValues);
-void saveSwing(struct sensorReadings* swingValues);
+void saveCalibration(unsigned char range, struct sensorReadings* calibrationValues);
+void loadSwing(unsigned char range, struct sensorReadings* swingValues);
+void saveSwing(unsigned char range, struct sensorReadings* swingValues);
+void defaultCalibration(unsigned char range, struct sensorReadings* calibrationValues, struct sensorReadings* swingValues);
+bool validCalibration(struct sensorReadings* calibrationValues, struct sensorReadings* swingValues);
+void loadRangeCalibration(struct settings* loadedSettings, struct sensorReadings* calibrationValues, struct sensorReadings* swingValues);
 
 /********************************************************
 * EEPROM Addresses
@@ -63,6 +131,33 @@ void saveSwing(struct sensorReadings* swingValues);
 #define EEPROM_SWING_ADDRESS (EEPROM_CALIBRATION_ADDRESS + EEPROM_CALIBRATION_SIZE)
 #define EEPROM_SWING_SIZE	12
 
+//Options added after the original settings block live after the swing values,
+// so the calibration and swing addresses of existing boards don't move.
+// Each option is a single byte (unless noted), and a value that is out of range (i.e. an erased 0xFF) loads the default.
+// 16 bytes are reserved so new options can be added without moving anything stored after them.
+#define EEPROM_OPTIONS_ADDRESS (EEPROM_SWING_ADDRESS + EEPROM_SWING_SIZE)
+#define EEPROM_OPTIONS_SIZE	16
+#define EEPROM_AVERAGE_SHIFT	(EEPROM_OPTIONS_ADDRESS + 0)
+#define EEPROM_EXTRA_RESOLUTION	(EEPROM_OPTIONS_ADDRESS + 1)
+#define EEPROM_BURST_SIZE	(EEPROM_OPTIONS_ADDRESS + 2)
+#define EEPROM_ADC_CLOCK	(EEPROM_OPTIONS_ADDRESS + 3)
+#define EEPROM_ADC_DISCARD	(EEPROM_OPTIONS_ADDRESS + 4)
+#define EEPROM_AXIS_MASK	(EEPROM_OPTIONS_ADDRESS + 5)
+#define EEPROM_FILTER	(EEPROM_OPTIONS_ADDRESS + 6)
+#define EEPROM_FILTER_SHIFT	(EEPROM_OPTIONS_ADDRESS + 7)
+#define EEPROM_FILTER_CUTOFF	(EEPROM_OPTIONS_ADDRESS + 8)	//2 bytes, big endian
+#define EEPROM_TRIGGER_MODE	(EEPROM_OPTIONS_ADDRESS + 10)
+#define EEPROM_TRIGGER_THRESHOLD	(EEPROM_OPTIONS_ADDRESS + 11)	//2 bytes, big endian
+#define EEPROM_TRIGGER_PRE	(EEPROM_OPTIONS_ADDRESS + 13)
+#define EEPROM_TRIGGER_POST	(EEPROM_OPTIONS_ADDRESS + 14)
+
+//The calibration and swing values above belong to the 1.5g range. The 6g range has its own
+// set after the options, laid out the same way. Erased values load the datasheet defaults.
+#define EEPROM_CALIBRATION_60_ADDRESS (EEPROM_OPTIONS_ADDRESS + EEPROM_OPTIONS_SIZE)
+#define EEPROM_SWING_60_ADDRESS (EEPROM_CALIBRATION_60_ADDRESS + EEPROM_CALIBRATION_SIZE)
+#define EEPROM_CALIBRATION_FOR(range)	(((range) == RANGE_INDEX_60) ? EEPROM_CALIBRATION_60_ADDRESS : EEPROM_CALIBRATION_ADDRESS)
+#define EEPROM_SWING_FOR(range)	(((range) == RANGE_INDEX_60) ? EEPROM_SWING_60_ADDRESS : EEPROM_SWING_ADDRESS)
+
 //*******************************************************
 //					GPIO Definitions
 //*******************************************************
@@ -70,6 +165,7 @@ void saveSwing(struct sensorReadings* swingValues);
 #define Z_AXIS	0
 #define Y_AXIS	1
 #define X_AXIS	2
+#define AXIS_MASK_ALL	((1<<X_AXIS)|(1<<Y_AXIS)|(1<<Z_AXIS))
 #define BOOT_RESET	3
 
 #define LED_PIN	5
@@ -91,14 +187,75 @@ void saveSwing(struct sensorReadings* swingValues);
 //These definitions can also be used to set the accelerometer range
 #define RANGE_15	800
 #define RANGE_60	206
+//Index of each range in the calibration arrays (see rangeSettings)
+#define RANGE_INDEX_15	0
+#define RANGE_INDEX_60	1
+#define NUM_RANGES	2
+#define RANGE_INDEX(range)	(((range) == RANGE_60) ? RANGE_INDEX_60 : RANGE_INDEX_15)
+
+//ADC reference voltage in mV and full scale count, used to convert counts to g values
+//(these must match the toVoltage macro)
+#define ADC_REFERENCE_MV	3300UL
+#define ADC_FULL_SCALE	1023UL
+//Smallest swing (in mV) accepted when building the gravity scale factors. Anything lower is
+//a bad calibration and would overflow the fixed point math.
+#define MIN_SWING_MV	50
+
+//Six position calibration (see selectCalibrationValues). Each side is measured from 2^CALIBRATION_SAMPLE_SHIFT samples
+//of all 3 axis taken at CALIBRATION_SAMPLE_RATE, about 2 seconds. The board counts as still while the average of the last
+//2^CALIBRATION_WINDOW_SHIFT readings of each axis stays within CALIBRATION_MAX_NOISE counts.
+#define CALIBRATION_SAMPLE_RATE	1000
+#define CALIBRATION_SAMPLE_SHIFT	11
+#define CALIBRATION_SAMPLES	(1U << CALIBRATION_SAMPLE_SHIFT)
+#define CALIBRATION_WINDOW_SHIFT	4
+#define CALIBRATION_MAX_NOISE	6
 
-//Define the number of readings to average
-#define NUM_READINGS	4
+//Define the averaging window limits. The window is always a power of 2 so the average is a shift.
+//The default of 2^2 = 4 readings matches the original firmware.
+#define DEFAULT_AVERAGE_SHIFT	2
+#define MAX_AVERAGE_SHIFT	4
+#define MAX_AVERAGE_WINDOW	(1 << MAX_AVERAGE_SHIFT)
+//Oversampling sums 4^n samples and shifts by n to get n extra bits (up to 12 bit results)
+#define MAX_EXTRA_RESOLUTION	2
+
+//Defaults of the CIC and IIR decimation filters (see filter.h): 16 samples for each output and a 10 Hz cutoff
+#define DEFAULT_FILTER_SHIFT	4
+#define DEFAULT_FILTER_CUTOFF	10
+#define MAX_FILTER_CUTOFF	5000
+
+//Defaults of the triggered capture (see trigger.h): 2g, with 8 samples from before the trigger and 24 from after it,
+//which fills the history with all 3 axis enabled
+#define DEFAULT_TRIGGER_THRESHOLD	200
+#define DEFAULT_TRIGGER_PRE	8
+#define DEFAULT_TRIGGER_POST	24
+#define MAX_TRIGGER_THRESHOLD	1000
+
+//The highest conversion rate (all axis together) the ADC can keep up with at ADC_CLOCK (see adc.h). A triggered conversion
+//takes 13.5 ADC clocks, and the rate is rounded down to a whole kHz for some margin (9000 at the 125 kHz clock of an 8 MHz board).
+#define ADC_MAX_CONVERSION_RATE	((ADC_CLOCK * 2 / 27) / 1000 * 1000)
+//The fast ADC clocks (see adcSetClock) can convert quicker than the ADC interrupt and the main loop can keep up with.
+//The interrupt takes roughly 150 cycles, so this keeps it to about half of the CPU (25000 conversions/s at 8 MHz).
+//The 150 cycles are counted from the code, they haven't been measured on the hardware.
+#define ADC_MAX_ISR_RATE	((F_CPU) / 320)
+
+//Number of 3 axis samples the ADC interrupt can get ahead of the main loop. Must be a power of 2 (and no more than 128)
+#define SAMPLE_BUFFER_SIZE	16
+#define SAMPLE_BUFFER_MASK	(SAMPLE_BUFFER_SIZE - 1)
 
 //Define the output modes for the accelerometer data
 #define OUTPUT_GRAVITY	0
 #define OUTPUT_RAW	1
 #define OUTPUT_BINARY	2
+#define OUTPUT_FRAMED	3
+#define OUTPUT_BURST	4
+#define OUTPUT_PACKED	5
+#define OUTPUT_DELTA	6
+#define NUM_OUTPUT_MODES	7
+
+//Define the limits for the number of samples in each burst frame. The largest burst frame
+//(16 * 6 byte samples plus the frame header and CRC) still fits in the UART transmit buffer.
+#define DEFAULT_BURST_SIZE	8
+#define MAX_BURST_SIZE	16
 
 //Define the Baud Rate Selections
 #define BAUD_4800	0
@@ -108,6 +265,10 @@ void saveSwing(struct sensorReadings* swingValues);
 #define BAUD_38400	4
 #define BAUD_57600	5
 #define BAUD_115200	6
+#define BAUD_250000	7
+#define BAUD_500000	8
+#define BAUD_1000000	9
+#define NUM_BAUD_RATES	10
 
 //Define the menu selections for the configuration menu
 #define MENU_CALIBRATE	'1'
@@ -115,4 +276,32 @@ void saveSwing(struct sensorReadings* swingValues);
 #define MENU_FREQUENCY	'3'
 #define MENU_RANGE	'4'
 #define MENU_BAUD	'5'
-#define MENU_EXIT	'X'
\ No newline at end of file
+#define MENU_AVERAGING	'6'
+#define MENU_RESOLUTION	'7'
+#define MENU_BURST	'8'
+#define MENU_DIAGNOSTICS	'9'
+#define MENU_ADC	'A'
+#define MENU_AXES	'B'
+#define MENU_FILTER	'C'
+#define MENU_TRIGGER	'D'
+#define MENU_EXIT	'X'
+
+//Sending this character during measurement mode queues a FRAME_TYPE_STATUS frame instead of stopping
+#define STATUS_REQUEST	'?'
+//Sending this character during measurement mode clears the performance counters (i.e. to leave out the start up)
+#define STATUS_CLEAR	'!'
+//Sending these characters during measurement mode switches to the 1.5g or the 6g range, along with its calibration
+#define RANGE_SELECT_15	'-'
+#define RANGE_SELECT_60	'+'
+//Size of the FRAME_TYPE_STATUS payload (see frame.h)
+#define STATUS_PAYLOAD_SIZE	28
+//Size of the settings sent in FRAME_TYPE_REPLY frames (see COMMAND_GET_SETTINGS in command.h)
+#define SETTINGS_PAYLOAD_SIZE	23
+//The largest FRAME_TYPE_REPLY payload: the command, the result and the status counters
+#define REPLY_PAYLOAD_SIZE	(2 + STATUS_PAYLOAD_SIZE)
+
+//What main has to do after runCommand has changed the settings
+#define COMMAND_ACTION_SETUP	0x01	//The sampling, output mode or baud rate changed, so measurement mode has to be set up again
+#define COMMAND_ACTION_RANGE	0x02	//The accelerometer range changed
+#define COMMAND_ACTION_START	0x04	//Start measurement mode
+#define COMMAND_ACTION_STOP	0x08	//Stop measurement mode
\ No newline at end of file
@@ -5,11 +5,17 @@
 #include <stdio.h>
 #include <ctype.h>
 #include <avr/io.h>
+#include <avr/pgmspace.h>
 #include "adc.h"
 
 #define sbi(var, mask)   ((var) |= (uint8_t)(1 << mask))
 #define cbi(var, mask)   ((var) &= (uint8_t)~(1 << mask))
 
+//Highest ADC clock of each ADC_CLOCK_... setting
+static const unsigned long adcClockLimits[NUM_ADC_CLOCKS] PROGMEM = {ADC_MAX_CLOCK, 500000UL, 1000000UL};
+
+struct adcScanState adcScan;
+
 //Function: adcRead(char) - Reads the ADC count value of a specified ADC channel
 //Inputs: char channel - The ADC channel to be read
 //Outputs: None
@@ -60,16 +66,8 @@ void adcInit(char reference, char align)
 	ADMUX = (reference << REFS0);	//Shift the reference voltage into the ADMUX register
 	ADMUX |= (align << ADLAR);		//Shift the left adjust into the ADMUX register
 	
-	//ADCSRA = clock;		//Set the ADC clock prescaler
-	
-	// set a2d prescale factor to 64
-	// 8 MHz / 64 = 125 KHz, inside the desired 50-200 KHz range.
-	// TODO: this will not work properly for other clock speeds, and
-	// this code should use F_CPU to determine the prescale factor.
-	sbi(ADCSRA, ADPS2);
-	sbi(ADCSRA, ADPS1);
-	//sbi(ADCSRA, ADPS0);
-	
+	//Set the ADC clock prescaler (picked from F_CPU in adc.h)
+	ADCSRA = (ADCSRA & ~((1<<ADPS2)|(1<<ADPS1)|(1<<ADPS0))) | ADC_PRESCALER_BITS;
 
 	// enable a2d conversions
 	sbi(ADCSRA, ADEN);	
@@ -84,6 +82,7 @@ void adcFreeRunning(char active)
 {
 	if(active != 0)	
 	{
+		ADCSRB = (ADCSRB & 0xF8) | ADC_TRIGGER_FREE_RUNNING;	//Each conversion triggers the next one
 		sbi(ADCSRA, ADATE); //Enable automatic triggering
 		sbi(ADCSRA, ADIE);	//Enable ADC Interrupts (Interrupt will be triggered after every read)
 		sbi(ADCSRA, ADSC);	//Start the free running readings (Interrupts will not start until sei() is called);
@@ -93,4 +92,104 @@ void adcFreeRunning(char active)
 		cbi(ADCSRA, ADIE);
 		cbi(ADCSRA, ADSC);
 	}
-}
\ No newline at end of file
+}
+
+//Description: Lets timer 1 start the ADC conversions.
+//Notes: A conversion is started on every timer 1 compare match B event (see timer1Init), so the
+// conversion rate is set exactly by the timer instead of the ADC clock. The ADC interrupt must clear
+// OCF1B after each conversion, otherwise the next compare match won't produce the rising edge that
+// starts a conversion. Because the next conversion doesn't start until the next compare match,
+// ADMUX can be changed in the ADC interrupt and the new channel is used for the next conversion.
+void adcTimerTriggered(char active)
+{
+	if(active != 0)
+	{
+		ADCSRB = (ADCSRB & 0xF8) | ADC_TRIGGER_TIMER1_COMPB;
+		sbi(ADCSRA, ADIF);	//Clear a completion flag left over from adcRead so it doesn't fire the interrupt early
+		TIFR1 = (1<<OCF1B);	//Make sure the first compare match creates a rising edge
+		sbi(ADCSRA, ADATE); //Enable automatic triggering
+		sbi(ADCSRA, ADIE);	//Enable ADC Interrupts (Interrupt will be triggered after every read)
+	}
+	else{
+		cbi(ADCSRA, ADATE);
+		cbi(ADCSRA, ADIE);
+	}
+}
+
+//Description: Returns the ADPS prescaler bits for an ADC_CLOCK_... setting: the smallest prescaler that keeps the
+// ADC clock under the limit of the setting (never under 2, the smallest the ADC has)
+static char adcPrescalerBits(char clock)
+{
+	unsigned long limit = pgm_read_dword(&adcClockLimits[(int)clock]);
+	char bits = 1;
+	
+	while((bits < 7) && ((F_CPU >> bits) > limit))bits++;
+	return bits;
+}
+
+//Description: Returns the ADC clock (in Hz) an ADC_CLOCK_... setting gives at this F_CPU
+//Usage: kHz = adcClockRate(ADC_CLOCK_FAST) / 1000;
+unsigned long adcClockRate(char clock)
+{
+	return F_CPU >> adcPrescalerBits(clock);
+}
+
+//Description: Sets the ADC clock prescaler. Should only be changed while no conversion is running.
+//Inputs: clock - ADC_CLOCK_STANDARD, ADC_CLOCK_FAST or ADC_CLOCK_FASTEST
+//Return: The new ADC clock in Hz
+//Usage: adcSetClock(ADC_CLOCK_FAST);
+unsigned long adcSetClock(char clock)
+{
+	ADCSRA = (ADCSRA & ~((1<<ADPS2)|(1<<ADPS1)|(1<<ADPS0))) | adcPrescalerBits(clock);
+	return adcClockRate(clock);
+}
+
+//Description: Returns the highest rate of triggered conversions (all channels together) an ADC clock setting can keep up with.
+// A triggered conversion takes 13.5 ADC clocks, and the rate is rounded down to a whole kHz for some margin.
+//Usage: rate = adcConversionRate(ADC_CLOCK_STANDARD);	//9000 at 8 MHz
+unsigned long adcConversionRate(char clock)
+{
+	return (adcClockRate(clock) * 2 / 27) / 1000 * 1000;
+}
+
+//Description: Starts converting a list of channels over and over (see adcScanNext)
+//Inputs: channels, count - the channels to convert, in order (1 to ADC_SCAN_MAX_CHANNELS of them)
+//		  trigger - ADC_TRIGGER_TIMER1_COMPB (timer 1 has to be started separately) or ADC_TRIGGER_FREE_RUNNING
+//		  discard - if not 0, each channel is converted twice and the first reading is thrown away
+//Usage: adcScanStart(axisList, 3, ADC_TRIGGER_TIMER1_COMPB, 0);
+void adcScanStart(const unsigned char* channels, unsigned char count, char trigger, char discard)
+{
+	unsigned int wait;
+	
+	adcScanStop();
+	if(count > ADC_SCAN_MAX_CHANNELS)count = ADC_SCAN_MAX_CHANNELS;
+	for(unsigned char i=0; i < count; i++)adcScan.channels[i] = channels[i] & 0x0F;
+	adcScan.slotShift = (discard != 0);
+	adcScan.slots = count << adcScan.slotShift;
+	adcScan.slot = 0;
+	
+	//The first conversion uses the first channel
+	ADMUX = (ADMUX & 0xF0) | adcScan.channels[0];
+	if(trigger == ADC_TRIGGER_FREE_RUNNING){
+		adcScan.depth = 2;
+		adcFreeRunning(1);
+		//The second conversion starts as soon as the first one finishes, before the interrupt can change the channel,
+		//so queue its channel now. The multiplexer setting is latched within 2 ADC clocks of the start.
+		for(wait = 4 << (ADCSRA & 0x07); wait; wait--)(void)ADCSRA;
+		ADMUX = (ADMUX & 0xF0) | adcScan.channels[(adcScan.slots > 1) ? (1 >> adcScan.slotShift) : 0];
+	}
+	else{
+		adcScan.depth = 1;
+		adcTimerTriggered(1);
+	}
+}
+
+//Description: Stops the conversion scheduler. A conversion that has already started still finishes, so this waits for it
+// and clears its completion flag. Otherwise the next adcScanStart would take its reading (of the old channel) as the first channel.
+void adcScanStop(void)
+{
+	adcTimerTriggered(0);
+	adcFreeRunning(0);
+	while(ADCSRA & (1<<ADSC));
+	sbi(ADCSRA, ADIF);
+}
@@ -9,9 +9,110 @@
 #define LEFT	1
 #define RIGHT	0
 
+//The ADC clock has to be between 50 and 200 kHz for full 10 bit resolution.
+//The smallest prescaler that keeps it under 200 kHz is picked at compile time from F_CPU
+//(8 MHz / 64 = 125 kHz, 16 MHz / 128 = 125 kHz, 20 MHz / 128 = 156 kHz).
+#define ADC_MAX_CLOCK	200000UL
+#define ADC_MIN_CLOCK	50000UL
+
+#if (F_CPU) / 2 <= ADC_MAX_CLOCK
+#define ADC_PRESCALER	2
+#define ADC_PRESCALER_BITS	1
+#elif (F_CPU) / 4 <= ADC_MAX_CLOCK
+#define ADC_PRESCALER	4
+#define ADC_PRESCALER_BITS	2
+#elif (F_CPU) / 8 <= ADC_MAX_CLOCK
+#define ADC_PRESCALER	8
+#define ADC_PRESCALER_BITS	3
+#elif (F_CPU) / 16 <= ADC_MAX_CLOCK
+#define ADC_PRESCALER	16
+#define ADC_PRESCALER_BITS	4
+#elif (F_CPU) / 32 <= ADC_MAX_CLOCK
+#define ADC_PRESCALER	32
+#define ADC_PRESCALER_BITS	5
+#elif (F_CPU) / 64 <= ADC_MAX_CLOCK
+#define ADC_PRESCALER	64
+#define ADC_PRESCALER_BITS	6
+#elif (F_CPU) / 128 <= ADC_MAX_CLOCK
+#define ADC_PRESCALER	128
+#define ADC_PRESCALER_BITS	7
+#else
+#error F_CPU is too fast for the ADC prescaler
+#endif
+
+#define ADC_CLOCK	((F_CPU) / ADC_PRESCALER)
+#if ADC_CLOCK < ADC_MIN_CLOCK
+#error F_CPU is too slow for a 50 kHz ADC clock
+#endif
+
+//ADC auto trigger sources (ADTS bits of ADCSRB)
+#define ADC_TRIGGER_FREE_RUNNING	0
+#define ADC_TRIGGER_TIMER1_COMPB	5
+
+//Selectable ADC clocks (see adcSetClock). The datasheet only promises the full 10 bit accuracy with
+//an ADC clock of 50 to 200 kHz, but a faster clock shortens every conversion (13 ADC clocks, 13.5 when
+//auto triggered), so it trades accuracy for sample rate:
+//	ADC_CLOCK_STANDARD	fastest clock up to 200 kHz (ADC_CLOCK), full 10 bit accuracy
+//	ADC_CLOCK_FAST		fastest clock up to 500 kHz, about 9 effective bits
+//	ADC_CLOCK_FASTEST	fastest clock up to 1 MHz, about 8 effective bits. The source impedance has to be
+//						low (well under the recommended 10k) for the sample and hold to settle in time.
+#define ADC_CLOCK_STANDARD	0
+#define ADC_CLOCK_FAST	1
+#define ADC_CLOCK_FASTEST	2
+#define NUM_ADC_CLOCKS	3
+
+//Conversion scheduler. Converts a list of channels over and over, started either by timer 1 or free running.
+//The multiplexer setting is latched when a conversion starts, so a channel written to ADMUX by the ADC interrupt is
+//used by the next conversion to start. When timer 1 starts the conversions that is the next one, but when free
+//running the next conversion has already started by the time the interrupt runs, so the new channel is only used
+//by the one after it. The scheduler keeps the multiplexer 'depth' conversions ahead, so adcScanNext always
+//returns the channel a reading really came from.
+//With discard on, each channel is converted twice in a row and the first reading after every multiplexer switch
+//is thrown away. That gives the sample and hold capacitor a whole conversion to settle on a new channel,
+//at the cost of half the conversion rate.
+#define ADC_SCAN_MAX_CHANNELS	8
+//Returned by adcScanNext for a reading that is thrown away
+#define ADC_SCAN_DISCARD	0xFF
+
+struct adcScanState{
+	unsigned char channels[ADC_SCAN_MAX_CHANNELS];
+	unsigned char slots;		//Conversions in one pass of the list (twice the number of channels when discarding)
+	unsigned char slotShift;	//1 when discarding, so slot >> slotShift is the channel index
+	unsigned char slot;			//The slot of the conversion that finishes next
+	unsigned char depth;		//Conversions between writing ADMUX and a conversion using it (1 triggered, 2 free running)
+};
+extern struct adcScanState adcScan;
+
 unsigned int adcRead(char channel);
 unsigned long adcVoltage(unsigned int adc_value);
 void adcInit(char reference, char align);
 void adcFreeRunning(char active);
+void adcTimerTriggered(char active);
+unsigned long adcClockRate(char clock);
+unsigned long adcSetClock(char clock);
+unsigned long adcConversionRate(char clock);
+void adcScanStart(const unsigned char* channels, unsigned char count, char trigger, char discard);
+void adcScanStop(void);
+
+//Description: Moves the conversion scheduler on by one conversion. Must be called from the ADC interrupt
+// for every conversion (inline, so the interrupt doesn't have to save every register).
+//Parameters: nextChannel - set to the channel the caller has to write to ADMUX now
+//Return: The channel of the conversion that just finished, or ADC_SCAN_DISCARD if its reading should be thrown away
+//Usage: axis = adcScanNext(&channel);
+//		 ADMUX = (ADMUX & 0xF0) | channel;
+static inline unsigned char adcScanNext(unsigned char* nextChannel)
+{
+	unsigned char slot = adcScan.slot, next;
+	
+	//The multiplexer is set for the conversion that starts 'depth' conversions from now
+	next = slot + adcScan.depth;
+	while(next >= adcScan.slots)next -= adcScan.slots;
+	*nextChannel = adcScan.channels[next >> adcScan.slotShift];
+	
+	adcScan.slot = (slot + 1 < adcScan.slots) ? slot + 1 : 0;
+	//When discarding, the first conversion of each pair is the one right after the switch
+	if(adcScan.slotShift && !(slot & 1))return ADC_SCAN_DISCARD;
+	return adcScan.channels[slot >> adcScan.slotShift];
+}
 
 #define toVoltage(count, voltage)	voltage = count * 3300 / 1023
\ No newline at end of file
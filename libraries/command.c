@@ -0,0 +1,90 @@
+/*********************************************************
+* Binary Command Library
+* Receives the binary commands a host program sends to
+* change the settings without going through the menu.
+*********************************************************/
+#include "crc16.h"
+#include "frame.h"
+#include "command.h"
+
+//Description: Throws away anything received of the current command and goes back to looking for the sync word
+void commandReset(struct commandParser* parser)
+{
+	parser->received = 0;
+}
+
+//Description: Throws away a command that is too long or fails its CRC check. The bytes after it are ignored until
+// COMMAND_TIMEOUT_MS passes or a new sync word starts, so the rest of a damaged command isn't taken for keys.
+static void commandDiscard(struct commandParser* parser)
+{
+	parser->received = COMMAND_DISCARDING;
+}
+
+//Description: Tells whether part of a command has been received, so the next byte belongs to it.
+// A command that stalls for more than COMMAND_TIMEOUT_MS is thrown away.
+//Inputs: now - the current time in ms (i.e. millis())
+//Return: 1 if a command is part way through (or the rest of a bad one is being thrown away), 0 if the parser is waiting for a sync word
+//Usage: if(commandPending(&parser, millis()) || (data == FRAME_SYNC1))commandParse(&parser, data, millis());
+char commandPending(struct commandParser* parser, unsigned long now)
+{
+	if((parser->received != 0) && (now - parser->lastTime > COMMAND_TIMEOUT_MS))commandReset(parser);
+	return parser->received != 0;
+}
+
+//Description: Adds a received byte to the command. Bytes outside of a command (before the sync word) are ignored.
+//Inputs: data - the received byte
+//		  now - the current time in ms (i.e. millis())
+//Return: 1 when the byte completes a command with a good CRC. parser->command, length and payload hold it until the next byte.
+//Usage: if(commandParse(&parser, uartReadChar(), millis()))runCommand(&parser);
+char commandParse(struct commandParser* parser, unsigned char data, unsigned long now)
+{
+	unsigned char position;
+	
+	commandPending(parser, now);
+	if(parser->received == COMMAND_DISCARDING){
+		//Only a new sync word (or the timeout) ends the discarding, other bytes don't hold it off
+		if(data == FRAME_SYNC1){
+			parser->received = 1;
+			parser->lastTime = now;
+		}
+		return 0;
+	}
+	parser->lastTime = now;
+	position = parser->received++;
+	
+	//Sync word
+	if(position == 0){
+		if(data != FRAME_SYNC1)commandReset(parser);
+		return 0;
+	}
+	if(position == 1){
+		if(data == FRAME_SYNC2)parser->crc = CRC16_INIT;
+		else if(data == FRAME_SYNC1)parser->received = 1;	//Could be the start of the real sync word
+		else commandReset(parser);
+		return 0;
+	}
+	
+	//Command, length and payload are covered by the CRC
+	if((position < 4) || (position < 4 + parser->length)){
+		parser->crc = crc16Update(parser->crc, data);
+		if(position == 2)parser->command = data;
+		else if(position == 3){
+			parser->length = data;
+			if(data > COMMAND_MAX_PAYLOAD)commandDiscard(parser);
+		}
+		else parser->payload[position - 4] = data;
+		return 0;
+	}
+	
+	//CRC, most significant byte first
+	if(position == 4 + parser->length){
+		if(data != (parser->crc >> 8))commandDiscard(parser);
+		return 0;
+	}
+	if(data != (parser->crc & 0xFF)){
+		commandDiscard(parser);
+		return 0;
+	}
+	commandReset(parser);
+	return 1;
+}
@@ -0,0 +1,72 @@
+/*********************************************************
+* Binary Command Library Header File
+* Receives the binary commands a host program sends to
+* change the settings without going through the menu.
+*
+* Command layout (multi-byte fields are big endian):
+*	sync		2 bytes	FRAME_SYNC1, FRAME_SYNC2 (as in frame.h)
+*	command		1 byte	what to do (COMMAND_...)
+*	length		1 byte	number of payload bytes (0 to COMMAND_MAX_PAYLOAD)
+*	payload		length bytes
+*	crc			2 bytes	CRC-16/CCITT (0x1021, initial value 0xFFFF) of command through payload
+*
+* Every command is answered with a FRAME_TYPE_REPLY frame (see frame.h). Its payload starts with the
+* command byte and a result (COMMAND_RESULT_...), followed by the data described below.
+* Commands that fail their CRC check or arrive with gaps longer than COMMAND_TIMEOUT_MS between
+* their bytes are ignored, so the host should send them again if no reply arrives. Anything
+* received in the COMMAND_TIMEOUT_MS after a bad command is ignored too (unless it is the
+* start of another command).
+*********************************************************/
+#include <stdint.h>
+
+//Longest command payload
+#define COMMAND_MAX_PAYLOAD	5
+//A command has to arrive without a gap longer than this (in ms) between its bytes
+#define COMMAND_TIMEOUT_MS	50
+
+//Commands. The reply to every command except COMMAND_GET_STATUS carries the settings (see COMMAND_GET_SETTINGS).
+#define COMMAND_GET_SETTINGS	0x01	//No payload. Reply data (23 bytes): range (0 = 1.5g, 1 = 6g), output mode, output frequency (2),
+									//baud rate (BAUD_...), average shift, extra resolution, burst size, ADC clock, ADC discard,
+									//axis mask, 1 while measuring, highest output frequency for these settings
+									//(2, an estimate that hasn't been measured when a CIC or IIR filter is on, see FILTER_CYCLES_CIC),
+									//filter (FILTER_... in filter.h), filter shift, filter cutoff in Hz (2),
+									//trigger mode (TRIGGER_... in trigger.h), trigger threshold in hundredths of a g (2),
+									//samples before the trigger, samples from the trigger on
+#define COMMAND_SET_RATE	0x02	//Output frequency in Hz (2). Refused if it is above the highest frequency for the settings.
+#define COMMAND_SET_MODE	0x03	//Output mode (1, OUTPUT_...). Lowers the output frequency if the new mode can't keep up.
+#define COMMAND_SET_RANGE	0x04	//Range (1, 0 = 1.5g, 1 = 6g). Takes effect straight away while measuring (like RANGE_SELECT_15/60).
+#define COMMAND_SET_BAUD	0x05	//Baud rate (1, BAUD_...). The reply is sent at the old baud rate, then the UART changes over.
+#define COMMAND_SET_AXES	0x06	//Axis mask (1, see FRAME_AXES_SHIFT). Lowers the output frequency if needed.
+#define COMMAND_START	0x07	//No payload. Starts measurement mode.
+#define COMMAND_STOP	0x08	//No payload. Stops measurement mode. The menu isn't shown until a key other than a command arrives.
+#define COMMAND_GET_STATUS	0x09	//No payload. Reply data is the FRAME_TYPE_STATUS payload.
+#define COMMAND_CLEAR_STATUS	0x0A	//No payload. Clears the performance counters (like STATUS_CLEAR).
+#define COMMAND_SAVE	0x0B	//No payload. Stores the settings in EEPROM. Changes made by commands are otherwise lost at power down.
+#define COMMAND_SET_FILTER	0x0C	//Filter (1, FILTER_...), samples per output as a power of 2 (1, 0 to FILTER_MAX_SHIFT) and cutoff in Hz (2).
+									//Lowers the output frequency if needed.
+#define COMMAND_SET_TRIGGER	0x0D	//Trigger mode (1, TRIGGER_...), threshold in hundredths of a g (2), samples before the trigger (1)
+									//and samples from the trigger on (1, at least 1). The two sample counts can't add up to more than the
+									//samples the history holds for the enabled axis (TRIGGER_BUFFER_SIZE / number of axis).
+
+//Command results (the second byte of each reply)
+#define COMMAND_RESULT_OK	0x00
+#define COMMAND_RESULT_UNKNOWN	0x01	//Not a command this firmware knows (the reply has no data)
+#define COMMAND_RESULT_BAD_LENGTH	0x02	//The payload is the wrong length for the command
+#define COMMAND_RESULT_BAD_VALUE	0x03	//The value is out of range, nothing was changed
+
+//parser->received while the rest of a bad command is being thrown away
+#define COMMAND_DISCARDING	0xFF
+
+//Description: Receive state of one command. Set to all 0 (or call commandReset) before the first byte.
+struct commandParser{
+	unsigned char received;	//Bytes of the current command received so far, 0 while looking for the sync word (or COMMAND_DISCARDING)
+	unsigned char command;
+	unsigned char length;
+	unsigned char payload[COMMAND_MAX_PAYLOAD];
+	uint16_t crc;
+	unsigned long lastTime;	//When the last byte arrived (in ms)
+};
+
+void commandReset(struct commandParser* parser);
+char commandPending(struct commandParser* parser, unsigned long now);
+char commandParse(struct commandParser* parser, unsigned char data, unsigned long now);
@@ -0,0 +1,21 @@
+/*********************************************************
+* CRC-16 Library
+* CRC-16/CCITT (polynomial 0x1021, initial value 0xFFFF,
+* not reflected) used to protect the binary frames.
+* Plain C, so it also builds for the host PC tools.
+*********************************************************/
+#include "crc16.h"
+
+//Description: Adds one byte to a CRC-16/CCITT (polynomial 0x1021, not reflected)
+// This is the byte at a time form of the shift register, so it doesn't need a lookup table.
+// The check value for the ASCII string "123456789" is 0x29B1.
+//Usage: crc = crc16Update(CRC16_INIT, data);
+uint16_t crc16Update(uint16_t crc, unsigned char data)
+{
+	crc = (crc >> 8) | (crc << 8);
+	crc ^= data;
+	crc ^= (crc & 0xFF) >> 4;
+	crc ^= crc << 12;
+	crc ^= (crc & 0xFF) << 5;
+	return crc;
+}
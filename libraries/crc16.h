@@ -0,0 +1,11 @@
+/*********************************************************
+* CRC-16 Library Header File
+* CRC-16/CCITT (polynomial 0x1021, initial value 0xFFFF,
+* not reflected) used to protect the binary frames.
+* Plain C, so it also builds for the host PC tools.
+*********************************************************/
+#include <stdint.h>
+
+#define CRC16_INIT	0xFFFF
+
+uint16_t crc16Update(uint16_t crc, unsigned char data);
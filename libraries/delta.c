@@ -0,0 +1,138 @@
+/*********************************************************
+* Delta Compression Library
+* Encodes samples of 1 to 3 axis as small per axis differences
+* for the compressed output mode, and decodes them again.
+* Plain C, so the decoder also builds for the host PC tools.
+*********************************************************/
+#include "delta.h"
+
+//Description: Adds a 4 bit nibble to the end of the payload
+static void deltaPutNibble(struct deltaEncoder* encoder, unsigned char nibble)
+{
+	if(encoder->halfByte){
+		encoder->buffer[encoder->length - 1] |= nibble;
+		encoder->halfByte = 0;
+	}
+	else{
+		encoder->buffer[encoder->length++] = nibble << 4;
+		encoder->halfByte = 1;
+	}
+}
+
+//Description: Adds one axis value as a zig-zag coded difference, or as an escaped absolute value if the difference is too big
+static void deltaPutValue(struct deltaEncoder* encoder, unsigned char axis, unsigned int value)
+{
+	int difference = (int)value - (int)encoder->previous[axis];
+	unsigned int zigzag;
+	
+	//Zig-zag coding puts small negative and positive differences next to each other: 0, -1, +1, -2, +2...
+	if(difference < 0)zigzag = (unsigned int)(-difference) * 2 - 1;
+	else zigzag = (unsigned int)difference * 2;
+	
+	if(zigzag <= DELTA_MAX_ZIGZAG)deltaPutNibble(encoder, zigzag);
+	else{
+		deltaPutNibble(encoder, DELTA_ESCAPE);
+		deltaPutNibble(encoder, (value >> 8) & 0x0F);
+		deltaPutNibble(encoder, (value >> 4) & 0x0F);
+		deltaPutNibble(encoder, value & 0x0F);
+	}
+	encoder->previous[axis] = value;
+}
+
+//Description: Starts a new payload in buffer. The buffer must hold DELTA_MAX_PAYLOAD bytes for the number of samples that will be added.
+//Inputs: axes - the number of values in each sample (1 to DELTA_MAX_AXES)
+//Usage: deltaStart(&encoder, framePayload, 3);
+void deltaStart(struct deltaEncoder* encoder, unsigned char* buffer, unsigned char axes)
+{
+	encoder->buffer = buffer;
+	encoder->length = 1;	//The first byte is the sample count, filled in by deltaFinish
+	encoder->count = 0;
+	encoder->halfByte = 0;
+	encoder->axes = axes;
+}
+
+//Description: Adds a sample to the payload. The first sample is the keyframe, the rest are stored as differences.
+//Inputs: values - one value for each axis
+//Usage: deltaAddSample(&encoder, axisValues);
+void deltaAddSample(struct deltaEncoder* encoder, const unsigned int* values)
+{
+	unsigned char* keyframe;
+	unsigned char axis;
+	
+	if(encoder->count == 0){
+		keyframe = &encoder->buffer[encoder->length];
+		for(axis = 0; axis < encoder->axes; axis++){
+			keyframe[axis * 2] = values[axis] >> 8;
+			keyframe[axis * 2 + 1] = values[axis];
+			encoder->previous[axis] = values[axis];
+		}
+		encoder->length += encoder->axes * 2;
+	}
+	else{
+		for(axis = 0; axis < encoder->axes; axis++)deltaPutValue(encoder, axis, values[axis]);
+	}
+	encoder->count++;
+}
+
+//Description: Finishes the payload (the last nibble is already padded with 0)
+//Returns: The payload length in bytes
+unsigned char deltaFinish(struct deltaEncoder* encoder)
+{
+	encoder->buffer[0] = encoder->count;
+	return encoder->length;
+}
+
+//Description: Reads the next nibble from a payload
+//Returns: The nibble, or -1 if the payload has run out
+static int deltaGetNibble(const unsigned char* payload, unsigned char length, unsigned int* position)
+{
+	unsigned int byte = *position >> 1;
+	
+	if(byte >= length)return -1;
+	if((*position)++ & 1)return payload[byte] & 0x0F;
+	return payload[byte] >> 4;
+}
+
+//Description: Decodes a delta compressed payload
+//Inputs: payload, length - the frame payload
+//		  samples - receives the decoded samples, axes values each (must hold axes * maxSamples values)
+//		  maxSamples - the most samples that fit in samples
+//		  axes - the number of values in each sample (1 to DELTA_MAX_AXES)
+//Return: The number of samples decoded, or -1 if the payload is malformed
+//Usage: count = deltaDecode(payload, length, samples, 16, 3);
+int deltaDecode(const unsigned char* payload, unsigned char length, unsigned int* samples, unsigned char maxSamples, unsigned char axes)
+{
+	unsigned char count, sample, axis;
+	unsigned int position;
+	int nibble, high, middle, low;
+	unsigned int previous[DELTA_MAX_AXES];
+	
+	if((axes == 0) || (axes > DELTA_MAX_AXES) || (length < 1 + axes * 2))return -1;
+	count = payload[0];
+	if((count == 0) || (count > maxSamples))return -1;
+	
+	for(axis = 0; axis < axes; axis++){
+		previous[axis] = ((unsigned int)payload[1 + axis * 2] << 8) | payload[2 + axis * 2];
+		samples[axis] = previous[axis];
+	}
+	
+	position = (1 + axes * 2) * 2;	//Nibble position of the first difference
+	for(sample = 1; sample < count; sample++){
+		for(axis = 0; axis < axes; axis++){
+			nibble = deltaGetNibble(payload, length, &position);
+			if(nibble < 0)return -1;
+			if(nibble == DELTA_ESCAPE){
+				high = deltaGetNibble(payload, length, &position);
+				middle = deltaGetNibble(payload, length, &position);
+				low = deltaGetNibble(payload, length, &position);
+				if((high < 0) || (middle < 0) || (low < 0))return -1;
+				previous[axis] = (high << 8) | (middle << 4) | low;
+			}
+			else if(nibble & 1)previous[axis] -= (nibble + 1) >> 1;
+			else previous[axis] += nibble >> 1;
+			previous[axis] &= 0x0FFF;
+			samples[sample * axes + axis] = previous[axis];
+		}
+	}
+	return count;
+}
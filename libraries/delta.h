@@ -0,0 +1,41 @@
+/*********************************************************
+* Delta Compression Library Header File
+* Encodes samples of 1 to 3 axis as small per axis differences
+* for the compressed output mode, and decodes them again.
+* Plain C, so the decoder also builds for the host PC tools.
+*
+* Payload layout:
+*	count		1 byte	number of samples in the payload
+*	keyframe	2 bytes per axis	first sample, each axis as a big endian 16 bit value
+*	deltas		a stream of 4 bit nibbles (high nibble first) for the other samples, one per axis in the same order.
+*				Nibble 0 to 14 is the zig-zag coded difference from the previous value of that axis
+*				(0=0, 1=-1, 2=+1, 3=-2 ... 14=+7). Nibble 15 is an escape: the next 3 nibbles hold
+*				the 12 bit absolute value. An odd number of nibbles is padded with a 0 nibble.
+*
+* Every payload starts with a keyframe, so a lost frame never corrupts the frames after it.
+*********************************************************/
+#define DELTA_ESCAPE	0x0F
+#define DELTA_MAX_ZIGZAG	14
+
+//Most axis in a sample
+#define DELTA_MAX_AXES	3
+
+//Largest payload for a number of samples (every delta escaped)
+#define DELTA_MAX_PAYLOAD(samples, axes)	(1 + 2 * (axes) * (samples))
+//Payload size when every delta fits in a nibble
+#define DELTA_MIN_PAYLOAD(samples, axes)	(1 + 2 * (axes) + ((axes) * ((samples) - 1) + 1) / 2)
+
+//Description: Keeps track of a payload while samples are being added to it
+struct deltaEncoder{
+	unsigned char* buffer;		//Start of the payload
+	unsigned char length;		//Bytes written so far (the last one may only have its high nibble filled in)
+	unsigned char count;		//Samples added so far
+	unsigned char halfByte;		//1 if the last byte is waiting for its low nibble
+	unsigned char axes;			//Values in each sample (1 to DELTA_MAX_AXES)
+	unsigned int previous[DELTA_MAX_AXES];	//Last value of each axis
+};
+
+void deltaStart(struct deltaEncoder* encoder, unsigned char* buffer, unsigned char axes);
+void deltaAddSample(struct deltaEncoder* encoder, const unsigned int* values);
+unsigned char deltaFinish(struct deltaEncoder* encoder);
+int deltaDecode(const unsigned char* payload, unsigned char length, unsigned int* samples, unsigned char maxSamples, unsigned char axes);
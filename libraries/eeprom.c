@@ -7,36 +7,137 @@
 * Modified by Ryan Owens
 * 6/17/2011
 *
+* Writes are queued and carried out by the EEPROM Ready
+* interrupt, so saving never busy-waits for the 3.4 ms
+* byte write or turns global interrupts off. A queued
+* byte that already holds the value is skipped.
+*
 *******************************************************/
 #include <stdlib.h>
 #include <stdio.h>
 #include <ctype.h>
 #include <avr/io.h>
+#include <avr/interrupt.h>
 #include "eeprom.h"
 
+//Write queue. The main program adds bytes at writeHead and the EEPROM Ready interrupt removes them from writeTail.
+static volatile unsigned int writeAddress[EEPROM_WRITE_QUEUE_SIZE];
+static volatile unsigned char writeData[EEPROM_WRITE_QUEUE_SIZE];
+static volatile unsigned char writeHead=0, writeTail=0;
+
+//Description: Starts the write of the next queued byte that differs from what is already stored. Disables the interrupt once the queue is empty.
+//Note: Must only be called when no write is in progress (EEPE clear). Shared by the EE_READY interrupt and the polled
+// path used when global interrupts are off.
+static void writeNext(void)
+{
+	unsigned char tail = writeTail;
+	unsigned int address;
+	unsigned char data;
+	
+	while(tail != writeHead){
+		address = writeAddress[tail];
+		data = writeData[tail];
+		tail = (tail + 1) & EEPROM_WRITE_QUEUE_MASK;
+		
+		//Read the byte first, and don't wear out the cell (or wait 3.4 ms) if it won't change
+		EEAR = address;
+		EECR |= (1<<EERE);
+		if(EEDR == data)continue;
+		
+		EEDR = data;
+		/* Write logical one to EEMPE */
+		EECR |= (1<<EEMPE);
+		/* Start eeprom write by setting EEPE */
+		EECR |= (1<<EEPE);
+		writeTail = tail;
+		return;
+	}
+	writeTail = tail;
+	EECR &= ~(1<<EERIE);	//Nothing left to write
+}
+
+//Description: If global interrupts are disabled the queue can't drain by itself, so start the next write by hand.
+static void writePoll(void)
+{
+	if(!(SREG & (1<<SREG_I)) && !(EECR & (1<<EEPE)))writeNext();
+}
+
+ISR(EE_READY_vect)
+{
+	writeNext();
+}
+
+//Description: Reads a byte of EEPROM. A byte that is still waiting in the write queue reads as its new value.
+//Note: The EEPROM Ready interrupt is held off while EEAR is in use (instead of disabling all interrupts),
+// and is turned back on afterwards if there is still something to write.
 unsigned char eepromReadChar(unsigned int uiAddress)
 {
-	/* Wait for completion of previous write */
-	while(EECR & (1<<EEPE));
-	/* Set up address register */
-	EEAR = uiAddress;
-	/* Start eeprom read by writing EERE */
-	EECR |= (1<<EERE);
-	/* Return data from Data Register */
-	return EEDR;
+	unsigned char tail, value;
+	char queued=0;
+	
+	EECR &= ~(1<<EERIE);
+	
+	//The newest queued write to the address wins
+	for(tail = writeTail; tail != writeHead; tail = (tail + 1) & EEPROM_WRITE_QUEUE_MASK){
+		if(writeAddress[tail] == uiAddress){
+			value = writeData[tail];
+			queued = 1;
+		}
+	}
+	if(!queued){
+		/* Wait for completion of previous write */
+		while(EECR & (1<<EEPE));
+		/* Set up address register */
+		EEAR = uiAddress;
+		/* Start eeprom read by writing EERE */
+		EECR |= (1<<EERE);
+		/* Return data from Data Register */
+		value = EEDR;
+	}
+	
+	if(writeTail != writeHead)EECR |= (1<<EERIE);
+	return value;
 }
 
+//Description: Queues a byte to be written to EEPROM. Only waits if the write queue is full.
 void eepromWriteChar(unsigned int uiAddress, unsigned char ucData)
 {
-	/* Wait for completion of previous write */
-	while(EECR & (1<<EEPE));
-	/* Set up address and Data Registers */
-	EEAR = uiAddress;
-	EEDR = ucData;
-	/* Write logical one to EEMPE */
-	EECR |= (1<<EEMPE);
-	/* Start eeprom write by setting EEPE */
-	EECR|= (1<<EEPE);
+	unsigned char head = writeHead;
+	unsigned char next = (head + 1) & EEPROM_WRITE_QUEUE_MASK;
+	
+	while(next == writeTail)writePoll();
+	writeAddress[head] = uiAddress;
+	writeData[head] = ucData;
+	writeHead = next;
+	
+	EECR |= (1<<EERIE);	//Make sure the EEPROM Ready interrupt is running
+	if(!(SREG & (1<<SREG_I)))writePoll();
+}
+
+//Description: Reads a block of bytes from EEPROM
+//Inputs: uiAddress - the EEPROM address of the first byte
+//		  buffer - receives length bytes
+//Usage: eepromReadBlock(EEPROM_CALIBRATION_ADDRESS, buffer, EEPROM_CALIBRATION_SIZE);
+void eepromReadBlock(unsigned int uiAddress, void* buffer, unsigned int length)
+{
+	unsigned char* data = buffer;
+	
+	while(length--)*data++ = eepromReadChar(uiAddress++);
+}
+
+//Description: Queues a block of bytes to be written to EEPROM. Bytes that haven't changed aren't written.
+//Usage: eepromWriteBlock(EEPROM_CALIBRATION_ADDRESS, buffer, EEPROM_CALIBRATION_SIZE);
+void eepromWriteBlock(unsigned int uiAddress, const void* buffer, unsigned int length)
+{
+	const unsigned char* data = buffer;
+	
+	while(length--)eepromWriteChar(uiAddress++, *data++);
+}
+
+//Description: Returns 1 while there are queued bytes still to be written (i.e. before a reset)
+unsigned char eepromBusy(void)
+{
+	return (writeTail != writeHead) || (EECR & (1<<EEPE));
 }
 
 //Description: Reads an unsigned integer from the specified address of EEPROM
@@ -7,9 +7,26 @@
 * Modified by Ryan Owens
 * 6/17/2011
 *
+* Writes are queued and carried out by the EEPROM Ready
+* interrupt (see eeprom.c).
+*
 *******************************************************/
+//Number of bytes that can be waiting to be written. Must be a power of 2 (and no larger than 256).
+//eepromWriteChar only has to wait when the queue is full.
+#ifndef EEPROM_WRITE_QUEUE_SIZE
+#define EEPROM_WRITE_QUEUE_SIZE	32
+#endif
+#define EEPROM_WRITE_QUEUE_MASK	(EEPROM_WRITE_QUEUE_SIZE - 1)
+
+#if (EEPROM_WRITE_QUEUE_SIZE & EEPROM_WRITE_QUEUE_MASK) || (EEPROM_WRITE_QUEUE_SIZE > 256)
+#error EEPROM_WRITE_QUEUE_SIZE must be a power of 2 no larger than 256
+#endif
+
 unsigned char eepromReadChar(unsigned int uiAddress);
 void eepromWriteChar(unsigned int uiAddress, unsigned char ucData);
+void eepromReadBlock(unsigned int uiAddress, void* buffer, unsigned int length);
+void eepromWriteBlock(unsigned int uiAddress, const void* buffer, unsigned int length);
+unsigned char eepromBusy(void);
 unsigned int eepromReadInt(unsigned int uiAddress);
 void eepromWriteInt(unsigned int uiAddress, unsigned int uiData);
 unsigned long eepromReadLong(unsigned int uiAddress);
@@ -0,0 +1,163 @@
+/*********************************************************
+* Decimation Filter Library
+* Fixed point CIC and IIR low-pass filters that take every
+* sample of 1 to 3 axis and reduce them to the output
+* frequency.
+*********************************************************/
+#include "filter.h"
+
+//2 * pi in Q14
+#define FILTER_TWO_PI_Q14	102944UL
+//A second order section pair is -3 dB at the cutoff when each section's cutoff is 1/sqrt(sqrt(2) - 1) = 1.554 times higher (Q10)
+#define FILTER_IIR2_CUTOFF_Q10	1591UL
+
+//Description: Works out the Q16 coefficient of a first order low-pass section, y += alpha * (x - y).
+// alpha = w / (1 + w), with w = 2 * pi * cutoff / sampleRate (the backward Euler form of the RC filter).
+static unsigned int filterAlpha(unsigned long sampleRate, unsigned long cutoff)
+{
+	unsigned long omega;
+	
+	//Keep the cutoff below the Nyquist frequency, which also keeps omega below pi (and the math within 32 bits)
+	if(cutoff > sampleRate / 2)cutoff = sampleRate / 2;
+	if(cutoff < 1)cutoff = 1;
+	omega = (cutoff * FILTER_TWO_PI_Q14 + sampleRate / 2) / sampleRate;
+	
+	return (omega << 16) / ((1UL << 14) + omega);
+}
+
+//Description: Returns (error * alpha) >> 16 for a Q16 error of up to +/-2^26 without needing a 64 bit product.
+// The error is split into its whole and fraction parts, so both multiplies are 16 x 16 bits.
+static long filterScale(long error, unsigned int alpha)
+{
+	int whole = error >> 16;
+	unsigned int fraction = error & 0xFFFF;
+	
+	return (long)whole * alpha + (((unsigned long)fraction * alpha) >> 16);
+}
+
+//Description: Sets up a filter and resets it
+//Inputs: type - FILTER_CIC2, FILTER_CIC3, FILTER_IIR1 or FILTER_IIR2
+//		  axes - number of values in each sample (1 to FILTER_MAX_AXES)
+//		  decimationShift - one output is taken every 2^decimationShift samples (0 to FILTER_MAX_SHIFT)
+//		  extraBits - the outputs are scaled up by 2^extraBits, to keep the extra resolution the filter gives
+//		  sampleRate, cutoff - the sample rate and the cutoff of the IIR filters, in Hz
+//Usage: filterInit(&sampleFilter, FILTER_IIR2, 3, 4, 0, 800, 10);	//10 Hz low-pass on 800 Hz samples, output at 50 Hz
+void filterInit(struct filterState* filter, unsigned char type, unsigned char axes, unsigned char decimationShift, unsigned char extraBits, unsigned long sampleRate, unsigned int cutoff)
+{
+	filter->type = type;
+	filter->axes = axes;
+	
+	if(FILTER_IS_IIR(type)){
+		//The state has 16 fraction bits
+		filter->stages = (type == FILTER_IIR2) ? 2 : 1;
+		filter->outputShift = 16 - extraBits;
+		if(type == FILTER_IIR2)filter->alpha = filterAlpha(sampleRate, ((unsigned long)cutoff * FILTER_IIR2_CUTOFF_Q10) >> 10);
+		else filter->alpha = filterAlpha(sampleRate, cutoff);
+	}
+	else{
+		//The gain of an order N CIC is (2^decimationShift)^N
+		filter->stages = (type == FILTER_CIC3) ? 3 : 2;
+		filter->outputShift = filter->stages * decimationShift - extraBits;
+		filter->alpha = 0;
+	}
+	filterReset(filter);
+}
+
+//Description: Clears the filter (i.e. after a range switch). The IIR filters start again from the next sample.
+// The CIC filters throw away their first outputs while they fill up.
+void filterReset(struct filterState* filter)
+{
+	for(unsigned char axis=0; axis < FILTER_MAX_AXES; axis++){
+		for(unsigned char stage=0; stage < FILTER_MAX_STAGES; stage++){
+			filter->stage[axis][stage] = 0;
+			filter->comb[axis][stage] = 0;
+		}
+	}
+	filter->primed = 0;
+	//An order N CIC output covers the last N output periods of samples
+	filter->warmUp = FILTER_IS_IIR(filter->type) ? 0 : filter->stages - 1;
+}
+
+//Description: Runs one sample through the filter. Must be called for every sample, at the full sample rate.
+//Inputs: values - one value for each axis
+//Usage: filterAddSample(&sampleFilter, values);
+void filterAddSample(struct filterState* filter, const unsigned int* values)
+{
+	uint32_t input;
+	
+	for(unsigned char axis=0; axis < filter->axes; axis++){
+		uint32_t* stage = filter->stage[axis];
+		
+		if(!FILTER_IS_IIR(filter->type)){
+			//CIC integrators. They wrap around modulo 2^32 (unsigned, so that is well defined), and the combs
+			//take the differences modulo 2^32 too, so the wraps cancel out.
+			input = values[axis];
+			for(unsigned char n=0; n < filter->stages; n++){
+				stage[n] += input;
+				input = stage[n];
+			}
+		}
+		else{
+			input = (uint32_t)values[axis] << 16;
+			//Start from the first sample rather than from 0, so there is no step to settle after a reset
+			if(!filter->primed){
+				for(unsigned char n=0; n < filter->stages; n++)stage[n] = input;
+			}
+			for(unsigned char n=0; n < filter->stages; n++){
+				//The IIR state stays within 0 to 1023 << 16, so the error fits in a long
+				stage[n] += filterScale((long)input - (long)stage[n], filter->alpha);
+				input = stage[n];
+			}
+		}
+	}
+	filter->primed = 1;
+}
+
+//Description: Takes the filtered value of each axis. Must be called once every 2^decimationShift samples.
+//Outputs: values - one value for each axis, scaled up by 2^extraBits
+//Return: 1 if the values are good, 0 while the filter is still filling up after a reset
+//Usage: if(filterOutput(&sampleFilter, values))send(values);
+char filterOutput(struct filterState* filter, unsigned int* values)
+{
+	uint32_t output, delayed;
+	long sum;
+	
+	for(unsigned char axis=0; axis < filter->axes; axis++){
+		output = filter->stage[axis][filter->stages - 1];
+		if(!FILTER_IS_IIR(filter->type)){
+			//CIC combs, at the output rate. The differences are taken modulo 2^32 like the integrators.
+			for(unsigned char n=0; n < filter->stages; n++){
+				delayed = filter->comb[axis][n];
+				filter->comb[axis][n] = output;
+				output -= delayed;
+			}
+			//After the last comb the value is the real filter sum, which FILTER_MAX_SHIFT keeps below 2^31
+			sum = output;
+			if(filter->outputShift >= 0)values[axis] = sum >> filter->outputShift;
+			else values[axis] = sum << -filter->outputShift;
+		}
+		//The IIR state has a fraction, so round it
+		else values[axis] = (output + (1L << (filter->outputShift - 1))) >> filter->outputShift;
+	}
+	if(filter->warmUp > 0){
+		filter->warmUp--;
+		return 0;
+	}
+	return 1;
+}
+
+//Description: Returns the rough number of main loop CPU cycles the filter takes for each value (see FILTER_CYCLES_CIC)
+unsigned int filterCycles(unsigned char type)
+{
+	switch(type){
+		case FILTER_CIC2:
+		case FILTER_CIC3:
+			return FILTER_CYCLES_CIC;
+		case FILTER_IIR1:
+			return FILTER_CYCLES_IIR;
+		case FILTER_IIR2:
+			return FILTER_CYCLES_IIR * 2;
+		default:
+			return 0;
+	}
+}
@@ -0,0 +1,50 @@
+/*********************************************************
+* Decimation Filter Library Header File
+* Fixed point CIC and IIR low-pass filters that take every
+* sample of 1 to 3 axis and reduce them to the output
+* frequency, so sampling faster than the output frequency
+* doesn't alias. The coefficients are worked out once by
+* filterInit, the per sample work is only adds, shifts and
+* 16 x 16 bit multiplies.
+*********************************************************/
+#include <stdint.h>
+
+//Filter types
+#define FILTER_AVERAGE	0	//Average of 2^n samples. This is the running total kept by the ADC interrupt, not this library.
+#define FILTER_CIC2	1	//Second order CIC decimator (sinc^2 response, nulls at every multiple of the output frequency)
+#define FILTER_CIC3	2	//Third order CIC decimator (sinc^3 response)
+#define FILTER_IIR1	3	//First order IIR low-pass at the sample rate. Every 2^n-th output is kept.
+#define FILTER_IIR2	4	//Second order IIR low-pass (two first order sections, each with its cutoff raised so the pair is -3 dB at the cutoff)
+#define NUM_FILTERS	5
+#define FILTER_IS_IIR(type)	(((type) == FILTER_IIR1) || ((type) == FILTER_IIR2))
+
+#define FILTER_MAX_AXES	3
+#define FILTER_MAX_STAGES	3
+//Largest decimation is 2^FILTER_MAX_SHIFT samples per output. A third order CIC grows by 3 bits for every
+//doubling, and 10 bit values have to stay within its 32 bit registers.
+#define FILTER_MAX_SHIFT	7
+
+//Rough number of CPU cycles each filter adds to the main loop for every value (one axis of one sample).
+//Used to keep the sample rate within what the main loop can filter. These are estimates from counting the
+//32 bit adds, shifts and multiplies in filterAddSample, they haven't been measured on the hardware.
+#define FILTER_CYCLES_CIC	50
+#define FILTER_CYCLES_IIR	150	//For each first order section
+
+//Description: State of a decimation filter. Set up by filterInit.
+struct filterState{
+	unsigned char type;		//FILTER_...
+	unsigned char axes;		//Number of values in each sample
+	unsigned char stages;	//CIC order, or number of IIR sections
+	signed char outputShift;	//The output is the last stage shifted right by this many bits (left if it is negative)
+	unsigned int alpha;		//Q16 coefficient of each IIR section
+	unsigned char warmUp;	//Outputs still to be thrown away after a reset, while the CIC fills up
+	unsigned char primed;	//IIR: 0 until the first sample after a reset has set the state
+	uint32_t stage[FILTER_MAX_AXES][FILTER_MAX_STAGES];	//CIC integrators (modulo 2^32), or IIR section outputs (Q16 counts)
+	uint32_t comb[FILTER_MAX_AXES][FILTER_MAX_STAGES];	//CIC comb delays
+};
+
+void filterInit(struct filterState* filter, unsigned char type, unsigned char axes, unsigned char decimationShift, unsigned char extraBits, unsigned long sampleRate, unsigned int cutoff);
+void filterReset(struct filterState* filter);
+void filterAddSample(struct filterState* filter, const unsigned int* values);
+char filterOutput(struct filterState* filter, unsigned int* values);
+unsigned int filterCycles(unsigned char type);
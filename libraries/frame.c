@@ -0,0 +1,52 @@
+/*********************************************************
+* Binary Frame Library
+* Builds CRC protected binary frames and queues them
+* on the UART transmit buffer.
+*********************************************************/
+#include <stdlib.h>
+#include <stdio.h>
+#include <ctype.h>
+#include <avr/io.h>
+#include "uart.h"
+#include "crc16.h"
+#include "frame.h"
+
+//Description: Queues a byte on the UART and adds it to the running CRC
+static void frameWriteByte(uint16_t* crc, unsigned char data)
+{
+	*crc = crc16Update(*crc, data);
+	uartWriteChar(data);
+}
+
+//Description: Queues a complete frame on the UART transmit buffer without waiting.
+// Either the whole frame is queued or none of it is, so a full buffer never produces a partial frame.
+//Inputs: type - FRAME_TYPE_... value describing the payload
+//		  sequence - the frame sequence number
+//		  timestamp - the time of the data in the frame
+//		  payload, length - the data for the frame
+//Return: 1 if the frame was queued, 0 if there wasn't room for it in the transmit buffer
+//Usage: if(!frameSend(FRAME_TYPE_SAMPLE, sequence++, millis(), data, 6))performance.framesDropped++;
+char frameSend(unsigned char type, unsigned int sequence, unsigned long timestamp, const unsigned char* payload, unsigned char length)
+{
+	uint16_t crc = CRC16_INIT;
+	
+	if(uartTxFree() < (unsigned int)length + FRAME_OVERHEAD)return 0;
+	
+	//The sync bytes aren't part of the CRC
+	uartWriteChar(FRAME_SYNC1);
+	uartWriteChar(FRAME_SYNC2);
+	
+	frameWriteByte(&crc, type);
+	frameWriteByte(&crc, length);
+	frameWriteByte(&crc, sequence >> 8);
+	frameWriteByte(&crc, sequence);
+	frameWriteByte(&crc, timestamp >> 24);
+	frameWriteByte(&crc, timestamp >> 16);
+	frameWriteByte(&crc, timestamp >> 8);
+	frameWriteByte(&crc, timestamp);
+	while(length--)frameWriteByte(&crc, *payload++);
+	
+	uartWriteChar(crc >> 8);
+	uartWriteChar(crc);
+	return 1;
+}
@@ -0,0 +1,43 @@
+/*********************************************************
+* Binary Frame Library Header File
+* Builds CRC protected binary frames and queues them
+* on the UART transmit buffer.
+*
+* Frame layout (multi-byte fields are big endian):
+*	sync		2 bytes	FRAME_SYNC1, FRAME_SYNC2
+*	type		1 byte	what the payload holds (FRAME_TYPE_...) in the low nibble, and the axis mask in the high nibble (see FRAME_AXES_SHIFT)
+*	length		1 byte	number of payload bytes
+*	sequence	2 bytes	increments for every frame, including frames that were dropped
+*	timestamp	4 bytes	milliseconds since power up
+*	payload		length bytes
+*	crc			2 bytes	CRC-16/CCITT (0x1021, initial value 0xFFFF) of type through payload
+*********************************************************/
+#define FRAME_SYNC1	0xA5
+#define FRAME_SYNC2	0x5A
+
+#define FRAME_HEADER_SIZE	10
+#define FRAME_CRC_SIZE	2
+#define FRAME_OVERHEAD	(FRAME_HEADER_SIZE + FRAME_CRC_SIZE)
+
+//The low nibble of the type byte is the frame type. The high nibble of sample frames is the mask of the
+//axis they carry (bit 2 X, bit 1 Y, bit 0 Z, the ADC channel of each axis). The values of the axis that
+//are there are always in X, Y, Z order. 0 means all 3 axis, as in frames from older firmware.
+#define FRAME_TYPE_MASK	0x0F
+#define FRAME_AXES_SHIFT	4
+
+//Frame types
+#define FRAME_TYPE_SAMPLE	0x01	//One sample, 3 axis of 16 bits
+#define FRAME_TYPE_BURST	0x02	//Consecutive samples of 3 axis of 16 bits each, oldest first. The timestamp is the time of the last sample.
+#define FRAME_TYPE_PACKED	0x03	//Like FRAME_TYPE_BURST, but each axis is 10 bits packed into a continuous big endian bit stream
+								//(X, Y, Z, X, Y, Z...). The last byte is padded with 0 bits. 1 sample = 4 bytes, 4 samples = 15 bytes.
+#define FRAME_TYPE_DELTA	0x04	//Consecutive samples, delta compressed (see delta.h). The timestamp is the time of the last sample.
+#define FRAME_TYPE_STATUS	0x05	//Performance counters, sent when requested during measurement mode. Payload (28 bytes):
+								//ADC conversions (4), frames sent (4), frames dropped (2), samples dropped (2), TX high water (2),
+								//TX overflows (2), RX overflows (2), RX overruns (2), max loop time in timer 2 ticks (2),
+								//ISR time in timer 1 ticks (4), timer 1 TOP (2, the period is one tick more)
+#define FRAME_TYPE_REPLY	0x06	//Answer to a binary command: command (1), result (1), then data that depends on the command (see command.h)
+#define FRAME_TYPE_EVENT	0x07	//Part of a triggered capture (see trigger.h): event number (2), index of the first sample in this frame (1),
+									//samples before the trigger (1), samples in the event (1), then the samples like FRAME_TYPE_BURST.
+									//Every frame of an event has the time of the trigger sample.
+
+char frameSend(unsigned char type, unsigned int sequence, unsigned long timestamp, const unsigned char* payload, unsigned char length);
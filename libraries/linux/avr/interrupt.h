@@ -0,0 +1,24 @@
+/*********************************************************
+* Linux backend: fake <avr/interrupt.h>
+* ISRs become ordinary functions that the simulator in
+* host.c calls. cli()/sei() block and unblock the signal
+* that drives the simulator.
+*********************************************************/
+#ifndef HOST_AVR_INTERRUPT_H
+#define HOST_AVR_INTERRUPT_H
+
+#include <avr/io.h>
+
+void hostCli(void);
+void hostSei(void);
+
+#define cli()	hostCli()
+#define sei()	hostSei()
+
+#define ISR_BLOCK
+#define ISR_NOBLOCK
+#define ISR_NAKED
+#define ISR(vector, ...)	void vector(void); void vector(void)
+#define EMPTY_INTERRUPT(vector)	void vector(void); void vector(void){}
+
+#endif
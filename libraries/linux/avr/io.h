@@ -0,0 +1,158 @@
+/*********************************************************
+* Linux backend: fake <avr/io.h> for the ATmega328
+*
+* Plain registers are ordinary variables. Registers with
+* write-one-to-clear flags, read-only status bits or side
+* effects on access (ADCSRA, TIFR1, TIFR2, UCSR0A, UDR0,
+* EECR, EEDR) go through accessor functions so the
+* simulated peripherals in host.c see every access.
+* Only the registers and bits the firmware uses are here.
+*********************************************************/
+#ifndef HOST_AVR_IO_H
+#define HOST_AVR_IO_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+//avr-libc stdio stream setup. The firmware's stream isn't used on the host, host.c
+//points stdout at the UART driver instead.
+#define FDEV_SETUP_STREAM(put, get, flags)	{0}
+#define _FDEV_SETUP_WRITE	2
+#ifndef HOST_SIMULATOR
+#undef stdout
+#define stdout hostFirmwareStdout
+extern FILE* hostFirmwareStdout;
+#endif
+
+#define _BV(bit)	(1 << (bit))
+#define bit_is_set(reg, bit)	((reg) & _BV(bit))
+#define bit_is_clear(reg, bit)	(!((reg) & _BV(bit)))
+#define loop_until_bit_is_set(reg, bit)	do{}while(bit_is_clear(reg, bit))
+#define loop_until_bit_is_clear(reg, bit)	do{}while(bit_is_set(reg, bit))
+
+//Status register
+extern volatile uint8_t SREG;
+#define SREG_I	7
+
+//GPIO
+extern volatile uint8_t PINB, DDRB, PORTB;
+extern volatile uint8_t PINC, DDRC, PORTC;
+extern volatile uint8_t PIND, DDRD, PORTD;
+
+//General purpose I/O registers
+extern volatile uint8_t GPIOR0, GPIOR1, GPIOR2;
+
+//ADC
+extern volatile uint8_t ADMUX, ADCSRB, ADCL, ADCH, DIDR0;
+volatile uint8_t* hostADCSRA(void);
+#define ADCSRA	(*hostADCSRA())
+#define MUX0	0
+#define MUX1	1
+#define MUX2	2
+#define MUX3	3
+#define ADLAR	5
+#define REFS0	6
+#define REFS1	7
+#define ADPS0	0
+#define ADPS1	1
+#define ADPS2	2
+#define ADIE	3
+#define ADIF	4
+#define ADATE	5
+#define ADSC	6
+#define ADEN	7
+#define ADTS0	0
+#define ADTS1	1
+#define ADTS2	2
+
+//Timer 1
+extern volatile uint8_t TCCR1A, TCCR1B, TCCR1C, TIMSK1;
+extern volatile uint16_t TCNT1, OCR1A, OCR1B, ICR1;
+volatile uint8_t* hostTIFR1(void);
+#define TIFR1	(*hostTIFR1())
+#define WGM10	0
+#define WGM11	1
+#define CS10	0
+#define CS11	1
+#define CS12	2
+#define WGM12	3
+#define WGM13	4
+#define TOIE1	0
+#define OCIE1A	1
+#define OCIE1B	2
+#define TOV1	0
+#define OCF1A	1
+#define OCF1B	2
+#define ICF1	5
+
+//Timer 2
+extern volatile uint8_t TCCR2A, TCCR2B, TCNT2, OCR2A, OCR2B, TIMSK2, ASSR;
+volatile uint8_t* hostTIFR2(void);
+#define TIFR2	(*hostTIFR2())
+#define WGM20	0
+#define WGM21	1
+#define CS20	0
+#define CS21	1
+#define CS22	2
+#define WGM22	3
+#define TOIE2	0
+#define OCIE2A	1
+#define OCIE2B	2
+#define TOV2	0
+#define OCF2A	1
+#define OCF2B	2
+
+//USART 0
+extern volatile uint8_t UCSR0B, UCSR0C, UBRR0H, UBRR0L;
+volatile uint8_t* hostUCSR0A(void);
+volatile uint16_t* hostUDR0(void);
+#define UCSR0A	(*hostUCSR0A())
+#define UDR0	(*hostUDR0())
+#define MPCM0	0
+#define U2X0	1
+#define UPE0	2
+#define DOR0	3
+#define FE0	4
+#define UDRE0	5
+#define TXC0	6
+#define RXC0	7
+#define TXB80	0
+#define RXB80	1
+#define UCSZ02	2
+#define TXEN0	3
+#define RXEN0	4
+#define UDRIE0	5
+#define TXCIE0	6
+#define RXCIE0	7
+#define UCPOL0	0
+#define UCSZ00	1
+#define UCSZ01	2
+#define USBS0	3
+
+//EEPROM
+extern volatile uint16_t EEAR;
+volatile uint8_t* hostEECR(void);
+volatile uint8_t* hostEEDR(void);
+#define EECR	(*hostEECR())
+#define EEDR	(*hostEEDR())
+#define EERE	0
+#define EEPE	1
+#define EEMPE	2
+#define EERIE	3
+#define EEPM0	4
+#define EEPM1	5
+
+//Interrupt vectors. ISR() turns these into ordinary functions that host.c calls.
+#define TIMER2_COMPA_vect	hostVectorTimer2CompA
+#define TIMER2_COMPB_vect	hostVectorTimer2CompB
+#define TIMER2_OVF_vect	hostVectorTimer2Ovf
+#define TIMER1_COMPA_vect	hostVectorTimer1CompA
+#define TIMER1_COMPB_vect	hostVectorTimer1CompB
+#define TIMER1_OVF_vect	hostVectorTimer1Ovf
+#define USART_RX_vect	hostVectorUsartRx
+#define USART_UDRE_vect	hostVectorUsartUdre
+#define USART_TX_vect	hostVectorUsartTx
+#define ADC_vect	hostVectorAdc
+#define EE_READY_vect	hostVectorEeReady
+
+#endif
@@ -0,0 +1,18 @@
+/*********************************************************
+* Linux backend: fake <avr/pgmspace.h>
+* There is only one address space on the host.
+*********************************************************/
+#ifndef HOST_AVR_PGMSPACE_H
+#define HOST_AVR_PGMSPACE_H
+
+#include <string.h>
+
+#define PROGMEM
+#define PSTR(s)	(s)
+#define pgm_read_byte(address)	(*(address))
+#define pgm_read_word(address)	(*(address))
+#define pgm_read_dword(address)	(*(address))
+#define printf_P	printf
+#define memcpy_P	memcpy
+
+#endif
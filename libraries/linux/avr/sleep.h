@@ -0,0 +1,17 @@
+/*********************************************************
+* Linux backend: fake <avr/sleep.h>
+* Sleeping waits for the next simulator tick.
+*********************************************************/
+#ifndef HOST_AVR_SLEEP_H
+#define HOST_AVR_SLEEP_H
+
+void hostSleep(void);
+
+#define SLEEP_MODE_IDLE	0
+#define set_sleep_mode(mode)
+#define sleep_enable()
+#define sleep_disable()
+#define sleep_cpu()	hostSleep()
+#define sleep_mode()	hostSleep()
+
+#endif
@@ -0,0 +1,910 @@
+/*********************************************************
+* Linux backend for the Serial Accelerometer firmware
+*
+* Simulates the ATmega328 peripherals the firmware uses
+* (timer 1, timer 2, the ADC, USART 0 and the EEPROM)
+* at the register level, so the firmware and its AVR
+* libraries build unchanged as a Linux program.
+*
+* A 1 ms interval timer signal plays the part of the
+* interrupt hardware. Each tick advances the simulated
+* peripherals to the wall clock in 8 CPU cycle steps and
+* calls the firmware's ISRs in vector priority order.
+* cli()/sei() block and unblock the signal. ISRs and the
+* main loop take no simulated time.
+*
+* The UART is connected to stdin/stdout, or to a pseudo
+* terminal. The accelerometer outputs come from a
+* scripted signal and the EEPROM is kept in a file.
+*
+* Settings (environment variables):
+*  HOST_PTY=1         use a pseudo terminal for the UART (its name is printed on stderr)
+*  HOST_INPUT=text    characters received before anything is read from stdin/the pty
+*  HOST_SIGNAL=file   accelerometer script, one "ms x y z" line per point in milli-g.
+*                     Values are interpolated between points and held after the last one.
+*                     Without a script the board sits flat (0, 0, 1000 mg).
+*  HOST_NOISE=n       +/- n ADC counts of random noise on every conversion (default 1)
+*  HOST_EEPROM=file   EEPROM contents (default eeprom.bin, created erased)
+*  HOST_BOOT_RESET=1  hold the boot reset pin low (restore the factory settings)
+*  HOST_RUN_MS=n      exit after n simulated milliseconds
+*
+* A summary of the UART and ADC throughput and of the
+* interrupt counts is printed on stderr at exit.
+*********************************************************/
+#define _GNU_SOURCE
+#define HOST_SIMULATOR
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include "SerialAccelerometer.h"
+
+//Simulation step and tick
+#define SIM_STEP_CYCLES	8
+#define SIM_TICK_US	1000
+//Longest stretch of wall clock time a tick will catch up on (i.e. after the process was stopped)
+#define SIM_MAX_BACKLOG	(F_CPU / 20)
+
+#define EEPROM_BYTES	1024
+//EEPROM write times from the datasheet: erase and write 3.4 ms, erase only or write only 1.8 ms
+#define EEPROM_WRITE_CYCLES	((F_CPU / 10000) * 34)
+#define EEPROM_HALF_CYCLES	((F_CPU / 10000) * 18)
+
+//Zero g output of the accelerometer (half the 3.3V supply) in mV
+#define ZERO_G_MV	1650
+
+//Interrupt vector numbers, used as the priority order and for the interrupt counts
+enum{
+	VECTOR_TIMER2_COMPA = 7,
+	VECTOR_TIMER2_COMPB,
+	VECTOR_TIMER2_OVF,
+	VECTOR_TIMER1_COMPA = 11,
+	VECTOR_TIMER1_COMPB,
+	VECTOR_TIMER1_OVF,
+	VECTOR_USART_RX = 18,
+	VECTOR_USART_UDRE,
+	VECTOR_USART_TX,
+	VECTOR_ADC,
+	VECTOR_EE_READY,
+	NUM_VECTORS
+};
+
+static const char* const vectorNames[NUM_VECTORS] = {
+	[VECTOR_TIMER2_COMPA] = "TIMER2_COMPA", [VECTOR_TIMER2_COMPB] = "TIMER2_COMPB", [VECTOR_TIMER2_OVF] = "TIMER2_OVF",
+	[VECTOR_TIMER1_COMPA] = "TIMER1_COMPA", [VECTOR_TIMER1_COMPB] = "TIMER1_COMPB", [VECTOR_TIMER1_OVF] = "TIMER1_OVF",
+	[VECTOR_USART_RX] = "USART_RX", [VECTOR_USART_UDRE] = "USART_UDRE", [VECTOR_USART_TX] = "USART_TX",
+	[VECTOR_ADC] = "ADC", [VECTOR_EE_READY] = "EE_READY",
+};
+
+//The firmware's ISRs. Any that aren't defined are left NULL.
+void TIMER2_COMPA_vect(void) __attribute__((weak));
+void TIMER2_COMPB_vect(void) __attribute__((weak));
+void TIMER2_OVF_vect(void) __attribute__((weak));
+void TIMER1_COMPA_vect(void) __attribute__((weak));
+void TIMER1_COMPB_vect(void) __attribute__((weak));
+void TIMER1_OVF_vect(void) __attribute__((weak));
+void USART_RX_vect(void) __attribute__((weak));
+void USART_UDRE_vect(void) __attribute__((weak));
+void USART_TX_vect(void) __attribute__((weak));
+void ADC_vect(void) __attribute__((weak));
+void EE_READY_vect(void) __attribute__((weak));
+
+int uartPutchar(char c, FILE *stream);
+
+/**************************************************************
+* Registers
+**************************************************************/
+volatile uint8_t SREG;
+volatile uint8_t PINB, DDRB, PORTB;
+volatile uint8_t PINC, DDRC, PORTC;
+volatile uint8_t PIND, DDRD, PORTD;
+volatile uint8_t GPIOR0, GPIOR1, GPIOR2;
+volatile uint8_t ADMUX, ADCSRB, ADCL, ADCH, DIDR0;
+volatile uint8_t TCCR1A, TCCR1B, TCCR1C, TIMSK1;
+volatile uint16_t TCNT1, OCR1A, OCR1B, ICR1;
+volatile uint8_t TCCR2A, TCCR2B, TCNT2, OCR2A, OCR2B, TIMSK2, ASSR;
+volatile uint8_t UCSR0B, UCSR0C, UBRR0H, UBRR0L;
+volatile uint16_t EEAR;
+
+//The firmware's 'stdout = &mystdout' lands here. The real stdout is pointed at uartPutchar instead.
+FILE* hostFirmwareStdout;
+
+//A register holding write-one-to-clear flags and read only status bits next to ordinary control bits.
+//The firmware reads and writes 'value' through an accessor. If 'value' no longer matches what was
+//presented last time the firmware has written it, and the flags written as one are cleared.
+//Marker bits are reserved bits that are always presented as one, so a write of the same flags can still be seen.
+struct flagRegister{
+	uint8_t value;
+	uint8_t presented;
+	uint8_t flags;
+	uint8_t status;
+	uint8_t flagMask;
+	uint8_t statusMask;
+	uint8_t marker;
+};
+
+static volatile struct flagRegister adcsra = {.flagMask = (1<<ADIF)};
+static volatile struct flagRegister tifr1 = {.flagMask = (1<<ICF1)|(1<<OCF1B)|(1<<OCF1A)|(1<<TOV1), .marker = 0x80};
+static volatile struct flagRegister tifr2 = {.flagMask = (1<<OCF2B)|(1<<OCF2A)|(1<<TOV2), .marker = 0x80};
+static volatile struct flagRegister ucsr0a = {.flagMask = (1<<TXC0), .statusMask = (1<<RXC0)|(1<<UDRE0)|(1<<FE0)|(1<<DOR0)|(1<<UPE0)};
+
+//UDR0 is wider than a byte so writes can be told apart from reads: it sits at UDR_EMPTY,
+//a received byte is presented with UDR_RECEIVED set, and anything else is a byte written by the firmware.
+#define UDR_EMPTY	0x100
+#define UDR_RECEIVED	0x200
+static volatile uint16_t udr0 = UDR_EMPTY;
+
+static volatile uint8_t eecr, eedr;
+
+/**************************************************************
+* Simulator state
+**************************************************************/
+static unsigned long long simCycles, runCycles;
+static struct timespec startTime;
+static volatile sig_atomic_t inTick, inInterrupt, hostBusy;
+static sigset_t tickSignal;
+
+static unsigned long timer1Clock, timer2Clock;
+
+static const unsigned char adcPrescalers[8] = {2, 2, 4, 8, 16, 32, 64, 128};
+static long adcCycles;
+static unsigned char adcChannel;
+static bool adcFirst = true;
+
+static bool txHolding;
+static unsigned char txHoldingByte, txShiftByte, rxData;
+static long txShiftCycles, rxCycles;
+static unsigned char rxQueue[256];
+static unsigned char rxQueueHead, rxQueueTail;
+
+static unsigned char eepromMemory[EEPROM_BYTES];
+static int eepromFile = -1;
+static long eepromBusy;
+
+static int wireIn = 0, wireOut = 1, ptySlave = -1;
+static bool restoreTerminal;
+static struct termios savedTerminal;
+static unsigned char wireBuffer[4096];
+static unsigned int wireLength;
+
+struct signalPoint{
+	unsigned long ms;
+	long mg[3];
+};
+static struct signalPoint* signalPoints;
+static unsigned int signalCount;
+static unsigned int noise = 1;
+static unsigned long randomState = 1;
+
+static unsigned long long txBytes, rxBytes, wireDropped, rxOverruns, adcConversions;
+static unsigned long long vectorCount[NUM_VECTORS];
+
+/**************************************************************
+* Flag registers
+**************************************************************/
+static void flagSync(volatile struct flagRegister* r)
+{
+	uint8_t control;
+
+	if(r->value != r->presented)r->flags &= ~(r->value & r->flagMask);
+	control = r->value & ~(r->flagMask | r->statusMask | r->marker);
+	r->value = control | r->flags | r->status | r->marker;
+	r->presented = r->value;
+}
+
+static void flagSet(volatile struct flagRegister* r, uint8_t bits)
+{
+	flagSync(r);
+	r->flags |= bits;
+	flagSync(r);
+}
+
+static void flagClear(volatile struct flagRegister* r, uint8_t bits)
+{
+	flagSync(r);
+	r->flags &= ~bits;
+	flagSync(r);
+}
+
+static void statusWrite(volatile struct flagRegister* r, uint8_t bits, bool on)
+{
+	flagSync(r);
+	if(on)r->status |= bits;
+	else r->status &= ~bits;
+	flagSync(r);
+}
+
+static void controlWrite(volatile struct flagRegister* r, uint8_t bits, bool on)
+{
+	flagSync(r);
+	if(on)r->value |= bits;
+	else r->value &= ~bits;
+	r->presented = r->value;
+}
+
+static bool flagIsSet(volatile struct flagRegister* r, uint8_t bits)
+{
+	flagSync(r);
+	return (r->value & bits) != 0;
+}
+
+/**************************************************************
+* Signal source
+**************************************************************/
+static long signalAt(unsigned char axis, unsigned long ms)
+{
+	unsigned int i;
+	const struct signalPoint *a, *b;
+
+	if(signalCount == 0)return (axis == 2) ? 1000 : 0;
+	if(ms <= signalPoints[0].ms)return signalPoints[0].mg[axis];
+	for(i = 1; i < signalCount; i++){
+		if(signalPoints[i].ms >= ms)break;
+	}
+	if(i == signalCount)return signalPoints[signalCount-1].mg[axis];
+	a = &signalPoints[i-1];
+	b = &signalPoints[i];
+	if(b->ms == a->ms)return b->mg[axis];
+	return a->mg[axis] + (b->mg[axis] - a->mg[axis]) * (long)(ms - a->ms) / (long)(b->ms - a->ms);
+}
+
+//Description: Returns the ADC count for a channel at the current simulated time.
+//The accelerometer's X, Y and Z outputs are on the X_AXIS, Y_AXIS and Z_AXIS channels, the sensitivity follows the g select pin.
+static unsigned int adcValue(unsigned char channel)
+{
+	unsigned long ms = simCycles / (F_CPU / 1000);
+	long mg, mv, count;
+
+	switch(channel){
+	case X_AXIS: mg = signalAt(0, ms); break;
+	case Y_AXIS: mg = signalAt(1, ms); break;
+	case Z_AXIS: mg = signalAt(2, ms); break;
+	case 14: return (1100L * 1024) / 3300;	//1.1V bandgap
+	default: return 0;
+	}
+	mv = ZERO_G_MV + mg * ((PORTD & (1<<G_SELECT)) ? RANGE_60 : RANGE_15) / 1000;
+	count = mv * 1024 / 3300;
+	if(noise){
+		randomState = randomState * 1103515245UL + 12345;
+		count += (long)((randomState >> 16) % (2 * noise + 1)) - (long)noise;
+	}
+	if(count < 0)count = 0;
+	if(count > 1023)count = 1023;
+	return count;
+}
+
+static void loadSignal(const char* path)
+{
+	FILE* file = fopen(path, "r");
+	char line[256];
+	unsigned int size = 0;
+
+	if(file == NULL){
+		fprintf(stderr, "host: can't open %s: %s\n", path, strerror(errno));
+		exit(1);
+	}
+	while(fgets(line, sizeof(line), file)){
+		struct signalPoint point;
+
+		if(sscanf(line, "%lu %ld %ld %ld", &point.ms, &point.mg[0], &point.mg[1], &point.mg[2]) != 4)continue;
+		if(signalCount == size){
+			size = size ? size * 2 : 64;
+			signalPoints = realloc(signalPoints, size * sizeof(*signalPoints));
+		}
+		signalPoints[signalCount++] = point;
+	}
+	fclose(file);
+}
+
+/**************************************************************
+* Timers
+**************************************************************/
+static const unsigned int timer1Prescalers[8] = {0, 1, 8, 64, 256, 1024, 0, 0};
+static const unsigned int timer2Prescalers[8] = {0, 1, 8, 32, 64, 128, 256, 1024};
+
+static void adcTrigger(unsigned char source);
+
+static void timer1Count(void)
+{
+	bool ctc = (TCCR1B & ((1<<WGM13)|(1<<WGM12))) == (1<<WGM12) && (TCCR1A & 3) == 0;
+
+	if(ctc && TCNT1 == OCR1A)TCNT1 = 0;
+	else if(++TCNT1 == 0)flagSet(&tifr1, 1<<TOV1);
+	if(TCNT1 == OCR1A)flagSet(&tifr1, 1<<OCF1A);
+	if(TCNT1 == OCR1B){
+		bool edge = !(tifr1.flags & (1<<OCF1B));
+		flagSet(&tifr1, 1<<OCF1B);
+		if(edge)adcTrigger(5);
+	}
+}
+
+static void timer2Count(void)
+{
+	bool ctc = !(TCCR2B & (1<<WGM22)) && (TCCR2A & 3) == (1<<WGM21);
+
+	if(ctc && TCNT2 == OCR2A)TCNT2 = 0;
+	else if(++TCNT2 == 0)flagSet(&tifr2, 1<<TOV2);
+	if(TCNT2 == OCR2A)flagSet(&tifr2, 1<<OCF2A);
+	if(TCNT2 == OCR2B)flagSet(&tifr2, 1<<OCF2B);
+}
+
+static void timerStep(unsigned int cycles)
+{
+	unsigned int prescaler;
+
+	prescaler = timer1Prescalers[TCCR1B & 7];
+	if(prescaler){
+		for(timer1Clock += cycles; timer1Clock >= prescaler; timer1Clock -= prescaler)timer1Count();
+	}
+	prescaler = timer2Prescalers[TCCR2B & 7];
+	if(prescaler){
+		for(timer2Clock += cycles; timer2Clock >= prescaler; timer2Clock -= prescaler)timer2Count();
+	}
+}
+
+/**************************************************************
+* ADC
+**************************************************************/
+//Description: Starts a conversion unless one is running. The channel is latched now, like the real ADC.
+static void adcStart(bool autoTriggered)
+{
+	unsigned int prescaler = adcPrescalers[adcsra.value & 7];
+
+	if(adcCycles > 0)return;
+	adcChannel = ADMUX & 0x0F;
+	if(adcFirst)adcCycles = 25 * prescaler;
+	else if(autoTriggered)adcCycles = 13 * prescaler + prescaler/2;
+	else adcCycles = 13 * prescaler;
+	adcFirst = false;
+}
+
+static void adcTrigger(unsigned char source)
+{
+	flagSync(&adcsra);
+	if(!(adcsra.value & (1<<ADEN)) || !(adcsra.value & (1<<ADATE)))return;
+	if((ADCSRB & 7) != source || adcCycles > 0)return;
+	controlWrite(&adcsra, 1<<ADSC, true);
+	adcStart(true);
+}
+
+static void adcStep(unsigned int cycles)
+{
+	unsigned int result;
+
+	flagSync(&adcsra);
+	if(!(adcsra.value & (1<<ADEN))){
+		adcCycles = 0;
+		adcFirst = true;
+		controlWrite(&adcsra, 1<<ADSC, false);
+		return;
+	}
+	if(adcCycles == 0){
+		if(adcsra.value & (1<<ADSC))adcStart(false);
+		return;
+	}
+	adcCycles -= cycles;
+	if(adcCycles > 0)return;
+	adcCycles = 0;
+
+	result = adcValue(adcChannel);
+	if(ADMUX & (1<<ADLAR)){
+		ADCH = result >> 2;
+		ADCL = (result & 3) << 6;
+	}
+	else{
+		ADCH = result >> 8;
+		ADCL = result & 0xFF;
+	}
+	adcConversions++;
+	flagSet(&adcsra, 1<<ADIF);
+
+	//Free running mode starts the next conversion straight away, on the channel selected right now
+	if((adcsra.value & (1<<ADATE)) && (ADCSRB & 7) == 0)adcStart(true);
+	else controlWrite(&adcsra, 1<<ADSC, false);
+}
+
+/**************************************************************
+* USART
+**************************************************************/
+static void wireFlush(void)
+{
+	unsigned int sent = 0;
+	ssize_t count;
+
+	while(sent < wireLength){
+		count = write(wireOut, &wireBuffer[sent], wireLength - sent);
+		if(count <= 0){
+			if(count < 0 && errno == EINTR)continue;
+			wireDropped += wireLength - sent;	//Nobody is reading the pty
+			break;
+		}
+		sent += count;
+	}
+	wireLength = 0;
+}
+
+//Description: Picks up a byte the firmware has written to UDR0 and puts it in the transmit holding register
+static void uartSync(void)
+{
+	uint16_t value = udr0;
+
+	udr0 = UDR_EMPTY;
+	if(value == UDR_EMPTY || (value >> 8) == (UDR_RECEIVED >> 8))return;
+	if(!(UCSR0B & (1<<TXEN0)))return;
+	txHolding = true;	//A write while the holding register is full overwrites it, like the real UART
+	txHoldingByte = value;
+	statusWrite(&ucsr0a, 1<<UDRE0, false);
+}
+
+static long uartByteCycles(void)
+{
+	unsigned long ubrr = ((UBRR0H & 0x0F) << 8) | UBRR0L;
+
+	flagSync(&ucsr0a);
+	return 10 * ((ucsr0a.value & (1<<U2X0)) ? 8 : 16) * (ubrr + 1);
+}
+
+static void uartStep(unsigned int cycles)
+{
+	long byteCycles = uartByteCycles();
+
+	uartSync();
+	if(txShiftCycles > 0){
+		txShiftCycles -= cycles;
+		if(txShiftCycles <= 0){
+			txShiftCycles = 0;
+			if(wireLength == sizeof(wireBuffer))wireFlush();
+			wireBuffer[wireLength++] = txShiftByte;
+			txBytes++;
+			if(!txHolding)flagSet(&ucsr0a, 1<<TXC0);
+		}
+	}
+	if(txShiftCycles == 0 && txHolding){
+		txShiftByte = txHoldingByte;
+		txHolding = false;
+		txShiftCycles = byteCycles;
+		statusWrite(&ucsr0a, 1<<UDRE0, true);
+	}
+
+	if(rxCycles > 0)rxCycles -= cycles;
+	if(rxCycles <= 0 && rxQueueHead != rxQueueTail && (UCSR0B & (1<<RXEN0))){
+		rxBytes++;
+		if(ucsr0a.status & (1<<RXC0)){
+			statusWrite(&ucsr0a, 1<<DOR0, true);	//The last byte hasn't been read yet, this one is lost
+			rxOverruns++;
+		}
+		else{
+			rxData = rxQueue[rxQueueTail];
+			statusWrite(&ucsr0a, 1<<RXC0, true);
+		}
+		rxQueueTail++;
+		rxCycles = byteCycles;
+	}
+}
+
+static void wireRead(void)
+{
+	struct pollfd input = {.fd = wireIn, .events = POLLIN};
+	unsigned char data[64];
+	ssize_t count, i;
+
+	if(wireIn < 0 || poll(&input, 1, 0) <= 0)return;
+	count = read(wireIn, data, sizeof(data));
+	if(count == 0 && ptySlave < 0)wireIn = -1;	//End of stdin
+	for(i = 0; i < count; i++){
+		if((unsigned char)(rxQueueHead + 1) == rxQueueTail)break;
+		rxQueue[rxQueueHead++] = data[i];
+	}
+}
+
+/**************************************************************
+* EEPROM
+**************************************************************/
+static void eepromSync(void)
+{
+	unsigned int address = EEAR & (EEPROM_BYTES - 1);
+	unsigned char mode;
+
+	if(eecr & (1<<EERE)){
+		eedr = eepromMemory[address];
+		eecr &= ~(1<<EERE);
+	}
+	if((eecr & (1<<EEPE)) && eepromBusy == 0){
+		mode = (eecr >> EEPM0) & 3;
+		if(mode == 1)eepromMemory[address] = 0xFF;
+		else if(mode == 2)eepromMemory[address] &= eedr;
+		else eepromMemory[address] = eedr;
+		eepromBusy = mode ? EEPROM_HALF_CYCLES : EEPROM_WRITE_CYCLES;
+		eecr &= ~(1<<EEMPE);
+		if(eepromFile >= 0 && pwrite(eepromFile, &eepromMemory[address], 1, address) != 1){
+			fprintf(stderr, "host: EEPROM file write failed: %s\n", strerror(errno));
+		}
+	}
+}
+
+static void eepromStep(unsigned int cycles)
+{
+	eepromSync();
+	if(eepromBusy == 0)return;
+	eepromBusy -= cycles;
+	if(eepromBusy <= 0){
+		eepromBusy = 0;
+		eecr &= ~(1<<EEPE);
+	}
+}
+
+static void loadEeprom(const char* path)
+{
+	ssize_t count;
+
+	memset(eepromMemory, 0xFF, sizeof(eepromMemory));
+	eepromFile = open(path, O_RDWR | O_CREAT, 0644);
+	if(eepromFile < 0){
+		fprintf(stderr, "host: can't open %s: %s\n", path, strerror(errno));
+		exit(1);
+	}
+	count = read(eepromFile, eepromMemory, sizeof(eepromMemory));
+	if(count < (ssize_t)sizeof(eepromMemory)){
+		if(count < 0)count = 0;
+		memset(&eepromMemory[count], 0xFF, sizeof(eepromMemory) - count);
+		if(pwrite(eepromFile, eepromMemory, sizeof(eepromMemory), 0) != sizeof(eepromMemory)){
+			fprintf(stderr, "host: can't write %s: %s\n", path, strerror(errno));
+		}
+	}
+}
+
+/**************************************************************
+* Interrupts
+**************************************************************/
+static void callVector(unsigned char vector, void (*isr)(void))
+{
+	vectorCount[vector]++;
+	if(isr == NULL)return;	//The real part would jump to the bad interrupt handler and reset
+	SREG &= ~(1<<SREG_I);
+	inInterrupt = 1;
+	isr();
+	inInterrupt = 0;
+	SREG |= (1<<SREG_I);	//reti
+	uartSync();
+	eepromSync();
+}
+
+//Description: Calls every pending interrupt that is enabled, highest priority (lowest vector) first.
+//Flags are cleared as the vector is taken, except the USART receive and data register empty and the EEPROM ready
+//interrupts, which stay pending until the ISR deals with their cause.
+static void dispatch(void)
+{
+	if(!(SREG & (1<<SREG_I)))return;
+
+	if((TIMSK2 & (1<<OCIE2A)) && flagIsSet(&tifr2, 1<<OCF2A)){
+		flagClear(&tifr2, 1<<OCF2A);
+		callVector(VECTOR_TIMER2_COMPA, TIMER2_COMPA_vect);
+	}
+	if((TIMSK2 & (1<<OCIE2B)) && flagIsSet(&tifr2, 1<<OCF2B)){
+		flagClear(&tifr2, 1<<OCF2B);
+		callVector(VECTOR_TIMER2_COMPB, TIMER2_COMPB_vect);
+	}
+	if((TIMSK2 & (1<<TOIE2)) && flagIsSet(&tifr2, 1<<TOV2)){
+		flagClear(&tifr2, 1<<TOV2);
+		callVector(VECTOR_TIMER2_OVF, TIMER2_OVF_vect);
+	}
+	if((TIMSK1 & (1<<OCIE1A)) && flagIsSet(&tifr1, 1<<OCF1A)){
+		flagClear(&tifr1, 1<<OCF1A);
+		callVector(VECTOR_TIMER1_COMPA, TIMER1_COMPA_vect);
+	}
+	if((TIMSK1 & (1<<OCIE1B)) && flagIsSet(&tifr1, 1<<OCF1B)){
+		flagClear(&tifr1, 1<<OCF1B);
+		callVector(VECTOR_TIMER1_COMPB, TIMER1_COMPB_vect);
+	}
+	if((TIMSK1 & (1<<TOIE1)) && flagIsSet(&tifr1, 1<<TOV1)){
+		flagClear(&tifr1, 1<<TOV1);
+		callVector(VECTOR_TIMER1_OVF, TIMER1_OVF_vect);
+	}
+	if((UCSR0B & (1<<RXCIE0)) && flagIsSet(&ucsr0a, 1<<RXC0) && USART_RX_vect){
+		callVector(VECTOR_USART_RX, USART_RX_vect);
+	}
+	if((UCSR0B & (1<<UDRIE0)) && flagIsSet(&ucsr0a, 1<<UDRE0) && USART_UDRE_vect){
+		callVector(VECTOR_USART_UDRE, USART_UDRE_vect);
+	}
+	if((UCSR0B & (1<<TXCIE0)) && flagIsSet(&ucsr0a, 1<<TXC0)){
+		flagClear(&ucsr0a, 1<<TXC0);
+		callVector(VECTOR_USART_TX, USART_TX_vect);
+	}
+	if(flagIsSet(&adcsra, 1<<ADIE) && flagIsSet(&adcsra, 1<<ADIF)){
+		flagClear(&adcsra, 1<<ADIF);
+		callVector(VECTOR_ADC, ADC_vect);
+	}
+	if((eecr & (1<<EERIE)) && !(eecr & (1<<EEPE)) && EE_READY_vect){
+		callVector(VECTOR_EE_READY, EE_READY_vect);
+	}
+}
+
+/**************************************************************
+* Simulation
+**************************************************************/
+static void report(void)
+{
+	double seconds = (double)simCycles / F_CPU;
+	unsigned long ubrr = ((UBRR0H & 0x0F) << 8) | UBRR0L;
+	double baud = (double)F_CPU / (((ucsr0a.value & (1<<U2X0)) ? 8 : 16) * (ubrr + 1));
+	unsigned int vector;
+
+	if(seconds <= 0)return;
+	fprintf(stderr, "\nhost: %.3f s simulated\n", seconds);
+	fprintf(stderr, "host: uart %.0f baud, tx %llu bytes (%.0f bytes/s, %.1f%% of the line), rx %llu bytes (%llu overruns)",
+		baud, txBytes, txBytes / seconds, 1000.0 * txBytes / (baud * seconds), rxBytes, rxOverruns);
+	if(wireDropped)fprintf(stderr, ", %llu bytes not read", wireDropped);
+	fprintf(stderr, "\nhost: adc %llu conversions (%.0f/s)\n", adcConversions, adcConversions / seconds);
+	fprintf(stderr, "host: interrupts");
+	for(vector = 0; vector < NUM_VECTORS; vector++){
+		if(vectorCount[vector])fprintf(stderr, " %s=%llu", vectorNames[vector], vectorCount[vector]);
+	}
+	fprintf(stderr, "\n");
+}
+
+static void finish(void)
+{
+	wireFlush();
+	if(restoreTerminal)tcsetattr(0, TCSANOW, &savedTerminal);
+	report();
+}
+
+//Description: Advances the simulated peripherals to the wall clock
+//Inputs: interrupts - call the pending ISRs as the peripherals run (only from the tick, with interrupts on)
+static void advance(bool interrupts)
+{
+	struct timespec now;
+	unsigned long long target;
+	unsigned long long nanoseconds;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	nanoseconds = (now.tv_sec - startTime.tv_sec) * 1000000000ULL + now.tv_nsec - startTime.tv_nsec;
+	target = (unsigned long long)((unsigned __int128)nanoseconds * F_CPU / 1000000000ULL);
+	if(target > simCycles + SIM_MAX_BACKLOG)simCycles = target - SIM_MAX_BACKLOG;
+
+	while(simCycles < target){
+		simCycles += SIM_STEP_CYCLES;
+		timerStep(SIM_STEP_CYCLES);
+		adcStep(SIM_STEP_CYCLES);
+		uartStep(SIM_STEP_CYCLES);
+		eepromStep(SIM_STEP_CYCLES);
+		if(interrupts)dispatch();
+		if(runCycles && simCycles >= runCycles){
+			finish();
+			_exit(0);
+		}
+	}
+	wireFlush();
+}
+
+static void tick(int signal)
+{
+	if(inTick || hostBusy)return;	//Catch up on the next tick
+	inTick = 1;
+	wireRead();
+	advance(true);
+	inTick = 0;
+}
+
+static void stop(int signal)
+{
+	finish();
+	_exit(128 + signal);
+}
+
+//Description: Called before the firmware touches one of the registers with side effects.
+//With interrupts off the tick can't run, so polled waits (i.e. for EEPE or TXC0) advance the peripherals themselves.
+static void enter(void)
+{
+	if(inTick)return;
+	hostBusy = 1;
+	if(!(SREG & (1<<SREG_I)))advance(false);
+}
+
+static void leave(void)
+{
+	if(!inTick)hostBusy = 0;
+}
+
+/**************************************************************
+* Register accessors and CPU functions used by the firmware
+**************************************************************/
+volatile uint8_t* hostADCSRA(void)
+{
+	enter();
+	flagSync(&adcsra);
+	//Writing 0 to ADSC has no effect, it reads as 1 until the conversion in progress finishes
+	if(adcCycles > 0)controlWrite(&adcsra, 1<<ADSC, true);
+	leave();
+	return &adcsra.value;
+}
+
+volatile uint8_t* hostTIFR1(void)
+{
+	enter();
+	flagSync(&tifr1);
+	leave();
+	return &tifr1.value;
+}
+
+volatile uint8_t* hostTIFR2(void)
+{
+	enter();
+	flagSync(&tifr2);
+	leave();
+	return &tifr2.value;
+}
+
+volatile uint8_t* hostUCSR0A(void)
+{
+	enter();
+	uartSync();
+	flagSync(&ucsr0a);
+	leave();
+	return &ucsr0a.value;
+}
+
+//Description: Reading UDR0 takes the received byte and clears RXC0 (and the overrun flag that goes with it)
+volatile uint16_t* hostUDR0(void)
+{
+	enter();
+	uartSync();
+	if(ucsr0a.status & (1<<RXC0)){
+		udr0 = UDR_RECEIVED | rxData;
+		statusWrite(&ucsr0a, (1<<RXC0)|(1<<DOR0), false);
+	}
+	leave();
+	return &udr0;
+}
+
+volatile uint8_t* hostEECR(void)
+{
+	enter();
+	eepromSync();
+	leave();
+	return &eecr;
+}
+
+//Description: Reading EEDR right after setting EERE gets the byte at EEAR, as the real read takes no time
+volatile uint8_t* hostEEDR(void)
+{
+	enter();
+	eepromSync();
+	leave();
+	return &eedr;
+}
+
+void hostCli(void)
+{
+	if(!inInterrupt && !inTick)sigprocmask(SIG_BLOCK, &tickSignal, NULL);
+	SREG &= ~(1<<SREG_I);
+}
+
+void hostSei(void)
+{
+	SREG |= (1<<SREG_I);
+	if(!inInterrupt && !inTick)sigprocmask(SIG_UNBLOCK, &tickSignal, NULL);
+}
+
+uint8_t hostSaveInterrupts(void)
+{
+	uint8_t sreg = SREG;
+
+	hostCli();
+	return sreg;
+}
+
+void hostRestoreInterrupts(uint8_t sreg)
+{
+	if(sreg & (1<<SREG_I))hostSei();
+	else hostCli();
+}
+
+//Description: Waits for the next interrupt, like the idle sleep mode
+void hostSleep(void)
+{
+	struct timespec wait = {0, SIM_TICK_US * 1000L};
+
+	if(SREG & (1<<SREG_I)){
+		sigset_t unblocked;
+
+		sigprocmask(SIG_SETMASK, NULL, &unblocked);
+		sigdelset(&unblocked, SIGALRM);
+		sigsuspend(&unblocked);
+	}
+	else{
+		nanosleep(&wait, NULL);	//Nothing can wake us, so just let the peripherals run
+		advance(false);
+	}
+}
+
+static ssize_t stdoutWrite(void* cookie, const char* data, size_t size)
+{
+	for(size_t i = 0; i < size; i++)uartPutchar(data[i], NULL);
+	return size;
+}
+
+static void openPty(void)
+{
+	struct termios settings;
+	int master = posix_openpt(O_RDWR | O_NOCTTY);
+
+	if(master < 0 || grantpt(master) < 0 || unlockpt(master) < 0){
+		fprintf(stderr, "host: can't open a pty: %s\n", strerror(errno));
+		exit(1);
+	}
+	//Keep the slave open so the master doesn't see a hangup before a terminal program connects
+	ptySlave = open(ptsname(master), O_RDWR | O_NOCTTY);
+	if(ptySlave >= 0 && tcgetattr(ptySlave, &settings) == 0){
+		cfmakeraw(&settings);
+		tcsetattr(ptySlave, TCSANOW, &settings);
+	}
+	fcntl(master, F_SETFL, O_NONBLOCK);
+	fprintf(stderr, "host: UART on %s\n", ptsname(master));
+	wireIn = wireOut = master;
+}
+
+//Description: Sets the simulator up before the firmware's main() runs
+__attribute__((constructor))
+static void hostInit(void)
+{
+	cookie_io_functions_t uartStream = {.write = stdoutWrite};
+	struct sigaction action;
+	struct itimerval interval = {{0, SIM_TICK_US}, {0, SIM_TICK_US}};
+	const char* setting;
+
+	//Interrupts are off out of reset
+	sigemptyset(&tickSignal);
+	sigaddset(&tickSignal, SIGALRM);
+	sigprocmask(SIG_BLOCK, &tickSignal, NULL);
+	SREG = 0;
+
+	setting = getenv("HOST_BOOT_RESET");
+	PINC = (setting && atoi(setting)) ? 0 : (1<<BOOT_RESET);
+	statusWrite(&ucsr0a, 1<<UDRE0, true);
+	flagSync(&adcsra);
+	flagSync(&tifr1);
+	flagSync(&tifr2);
+
+	setting = getenv("HOST_EEPROM");
+	loadEeprom(setting ? setting : "eeprom.bin");
+	if((setting = getenv("HOST_SIGNAL")))loadSignal(setting);
+	if((setting = getenv("HOST_NOISE")))noise = atoi(setting);
+	if((setting = getenv("HOST_RUN_MS")))runCycles = strtoull(setting, NULL, 10) * (F_CPU / 1000);
+	for(setting = getenv("HOST_INPUT"); setting && *setting; setting++)rxQueue[rxQueueHead++] = *setting;
+
+	if((setting = getenv("HOST_PTY")) && atoi(setting))openPty();
+	else if(isatty(0) && tcgetattr(0, &savedTerminal) == 0){
+		struct termios raw = savedTerminal;
+
+		raw.c_lflag &= ~(ICANON | ECHO);	//Send keys as they are typed, Ctrl-C still stops the program
+		raw.c_iflag &= ~(ICRNL);
+		tcsetattr(0, TCSANOW, &raw);
+		restoreTerminal = true;
+	}
+
+	//printf and putchar in the firmware go through the UART driver
+	stdout = fopencookie(NULL, "w", uartStream);
+	setvbuf(stdout, NULL, _IONBF, 0);
+
+	memset(&action, 0, sizeof(action));
+	action.sa_handler = stop;
+	sigaction(SIGINT, &action, NULL);
+	sigaction(SIGTERM, &action, NULL);
+	action.sa_handler = tick;
+	action.sa_flags = SA_RESTART;
+	sigaction(SIGALRM, &action, NULL);
+
+	clock_gettime(CLOCK_MONOTONIC, &startTime);
+	setitimer(ITIMER_REAL, &interval, NULL);
+}
@@ -0,0 +1,18 @@
+/*********************************************************
+* Linux backend: fake <util/atomic.h>
+*********************************************************/
+#ifndef HOST_UTIL_ATOMIC_H
+#define HOST_UTIL_ATOMIC_H
+
+#include <avr/interrupt.h>
+
+uint8_t hostSaveInterrupts(void);
+void hostRestoreInterrupts(uint8_t sreg);
+
+#define ATOMIC_RESTORESTATE	1
+#define ATOMIC_FORCEON	0
+//Runs the block once with interrupts off, then restores (or forces on) the interrupt flag
+#define ATOMIC_BLOCK(type)	for(uint8_t hostSavedSreg = hostSaveInterrupts(), hostOnce = 1; hostOnce; \
+	hostRestoreInterrupts((type) ? hostSavedSreg : (1 << SREG_I)), hostOnce = 0)
+
+#endif
@@ -0,0 +1,94 @@
+/*********************************************************
+* Throughput Planner
+* Works out the highest output frequency the UART and the
+* ADC can keep up with for a set of output settings.
+* Plain C, so it also builds for the host PC tools.
+*********************************************************/
+#include <stdbool.h>
+#include "SerialAccelerometer.h"
+#include "frame.h"
+#include "delta.h"
+#include "throughput.h"
+
+//Description: Returns the number of bytes sent for each frame of an output mode
+//Inputs: outputMode - one of the OUTPUT_... modes
+//		  burstSize - samples per frame for the burst modes
+//		  axes - the number of enabled axis (1 to 3)
+//		  samplesPerFrame - set to the number of samples carried by each frame
+//Return: The frame size in bytes. For delta compressed frames this is the nominal size, when every difference fits in a nibble.
+//Usage: bytes = outputFrameSize(OUTPUT_RAW, 1, 3, &samples);
+unsigned char outputFrameSize(int outputMode, int burstSize, unsigned char axes, unsigned char* samplesPerFrame)
+{
+	*samplesPerFrame = 1;
+	switch(outputMode){
+		case OUTPUT_GRAVITY:	return axes * 6 + 1;	//" 0.00\t 0.00\t 1.00\n\r"
+		case OUTPUT_RAW:		return axes * 5 + 1;	//"0512\t0512\t0760\n\r"
+		case OUTPUT_BINARY:		return axes * 2 + 2;	//'#' + 2 bytes per axis + '$'
+		case OUTPUT_FRAMED:		return FRAME_OVERHEAD + axes * 2;
+		default:
+			break;
+	}
+	
+	*samplesPerFrame = burstSize;
+	if(outputMode == OUTPUT_PACKED)return FRAME_OVERHEAD + (burstSize * axes * 10 + 7) / 8;
+	if(outputMode == OUTPUT_DELTA)return FRAME_OVERHEAD + DELTA_MIN_PAYLOAD(burstSize, axes);
+	return FRAME_OVERHEAD + burstSize * axes * 2;
+}
+
+//Description: Returns the highest sample rate the UART can carry
+//Inputs: baudRate - the UART baud rate. Each byte takes 10 bits (start bit, 8 data bits and stop bit).
+//		  frameBytes, samplesPerFrame - the size of each frame and the number of samples in it
+unsigned int linkLimit(unsigned long baudRate, unsigned char frameBytes, unsigned char samplesPerFrame)
+{
+	unsigned long limit = (baudRate * THROUGHPUT_LINK_PERCENT / 1000) * samplesPerFrame / frameBytes;
+	
+	if(limit > THROUGHPUT_MAX_FREQUENCY)limit = THROUGHPUT_MAX_FREQUENCY;
+	return limit;
+}
+
+//Description: Returns the highest output frequency the ADC can keep up with when every output value
+// is the average of 2^windowShift samples, and every sample takes one conversion for each enabled axis
+unsigned int adcLimit(unsigned long conversionRate, char windowShift, unsigned char axes)
+{
+	unsigned long limit = (conversionRate / axes) >> windowShift;
+	
+	//A fast clock at 16 or 20 MHz with one axis can go past what the outputFrequency setting holds
+	if(limit > THROUGHPUT_MAX_FREQUENCY)limit = THROUGHPUT_MAX_FREQUENCY;
+	return limit;
+}
+
+//Description: Returns the ADC conversions per second the firmware can keep up with
+//Inputs: conversionRate - the conversions per second the ADC clock allows (see adcConversionRate)
+//		  loopCycles - main loop CPU cycles spent on each conversion (i.e. filterCycles), 0 if there are none
+//		  discard - 1 if the first reading after each channel switch is thrown away
+//Usage: rate = usableConversionRate(adcConversionRate(settings.adcClock), 0, settings.adcDiscard);
+unsigned long usableConversionRate(unsigned long conversionRate, unsigned int loopCycles, char discard)
+{
+	//The fast ADC clocks can convert quicker than the ADC interrupt can keep up with
+	if(conversionRate > ADC_MAX_ISR_RATE)conversionRate = ADC_MAX_ISR_RATE;
+	//Work the main loop does for every conversion leaves less time for the interrupt
+	if((loopCycles > 0) && (conversionRate > (F_CPU) / (320 + loopCycles)))conversionRate = (F_CPU) / (320 + loopCycles);
+	//Discarded readings use up conversions too
+	return conversionRate >> discard;
+}
+
+//Description: Returns the highest output frequency that both the UART and the ADC can sustain
+//Inputs: outputMode, burstSize - the output settings
+//		  axes - the number of enabled axis (1 to 3)
+//		  baudRate - the UART baud rate
+//		  windowShift - each output value is the average of 2^windowShift samples
+//		  conversionRate - the ADC conversions per second for all axis together (i.e. ADC_MAX_CONVERSION_RATE)
+//Return: The output frequency limit in Hz (at least 1)
+//Usage: limit = throughputLimit(OUTPUT_GRAVITY, 1, 3, 115200, 2, ADC_MAX_CONVERSION_RATE);
+unsigned int throughputLimit(int outputMode, int burstSize, unsigned char axes, unsigned long baudRate, char windowShift, unsigned long conversionRate)
+{
+	unsigned char frameBytes, samplesPerFrame;
+	unsigned int limit, adc;
+	
+	frameBytes = outputFrameSize(outputMode, burstSize, axes, &samplesPerFrame);
+	limit = linkLimit(baudRate, frameBytes, samplesPerFrame);
+	adc = adcLimit(conversionRate, windowShift, axes);
+	if(adc < limit)limit = adc;
+	if(limit < 1)limit = 1;
+	return limit;
+}
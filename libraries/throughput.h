@@ -0,0 +1,19 @@
+/*********************************************************
+* Throughput Planner Header File
+* Works out the highest output frequency the UART and the
+* ADC can keep up with for a set of output settings.
+* Plain C, so it also builds for the host PC tools.
+*********************************************************/
+//Share of the raw baud rate that is counted on. The rest is left for gaps between bytes and
+//baud rate error. The interrupt driven transmit buffer keeps the UART busy back to back, and the
+//text modes of the original firmware were already measured at up to 99% of the baud rate limit.
+#define THROUGHPUT_LINK_PERCENT	95
+
+//Highest output frequency that fits in the int outputFrequency setting
+#define THROUGHPUT_MAX_FREQUENCY	32767U
+
+unsigned char outputFrameSize(int outputMode, int burstSize, unsigned char axes, unsigned char* samplesPerFrame);
+unsigned int linkLimit(unsigned long baudRate, unsigned char frameBytes, unsigned char samplesPerFrame);
+unsigned int adcLimit(unsigned long conversionRate, char windowShift, unsigned char axes);
+unsigned long usableConversionRate(unsigned long conversionRate, unsigned int loopCycles, char discard);
+unsigned int throughputLimit(int outputMode, int burstSize, unsigned char axes, unsigned long baudRate, char windowShift, unsigned long conversionRate);
@@ -0,0 +1,58 @@
+/*********************************************
+* Timer 1 Library for the ATmega328
+*
+* Uses the 16 bit timer 1 as a sample clock.
+* The compare match B event is used as the
+* ADC auto trigger source.
+**********************************************/
+#include <stdlib.h>
+#include <stdio.h>
+#include <ctype.h>
+#include <avr/io.h>
+#include <avr/pgmspace.h>
+#include "timer1.h"
+
+//Prescaler division factors, in the order of their CS1x clock select values (1 to 5)
+static const unsigned int timer1Prescalers[5] PROGMEM = {1, 8, 64, 256, 1024};
+
+//Description: Starts timer 1 in CTC mode so that a compare match B event happens 'frequency' times per second.
+// The smallest prescaler that fits is used to get the best resolution.
+//Inputs: frequency - Number of compare match events per second (1 to F_CPU/2)
+//Return: The actual event frequency (in Hz, rounded) after the period has been rounded to whole timer ticks
+//Usage: timer1Init(600);
+unsigned long timer1Init(unsigned long frequency)
+{
+	unsigned long ticks=0;
+	unsigned int prescaler=1;
+	char clockSelect;
+	
+	if(frequency == 0)frequency = 1;
+	
+	//Find the first prescaler that keeps the period inside the 16 bit counter
+	for(clockSelect = 1; clockSelect <= 5; clockSelect++){
+		prescaler = pgm_read_word(&timer1Prescalers[clockSelect-1]);
+		ticks = ((F_CPU / prescaler) + frequency/2) / frequency;
+		if(ticks <= 65536UL)break;
+	}
+	if(clockSelect > 5){
+		clockSelect = 5;
+		ticks = 65536UL;
+	}
+	if(ticks < 2)ticks = 2;
+	
+	TCCR1B = 0;		//Stop the timer while it is reconfigured
+	TCCR1A = 0;
+	TCNT1 = 0;
+	OCR1A = ticks - 1;	//TOP value for CTC mode
+	OCR1B = ticks - 1;	//Compare match B happens at TOP too, this is what triggers the ADC
+	TIFR1 = (1<<OCF1B)|(1<<OCF1A);	//Clear any stale compare flags
+	TCCR1B = (1<<WGM12) | clockSelect;	//CTC mode with OCR1A as TOP, start the timer
+	
+	return ((F_CPU / prescaler) + ticks/2) / ticks;
+}
+
+//Description: Stops timer 1
+void timer1Stop(void)
+{
+	TCCR1B = 0;
+}
@@ -0,0 +1,9 @@
+/*********************************************
+* Timer 1 Library Header File for the ATmega328
+*
+* Uses the 16 bit timer 1 as a sample clock.
+* The compare match B event is used as the
+* ADC auto trigger source.
+**********************************************/
+unsigned long timer1Init(unsigned long frequency);
+void timer1Stop(void);
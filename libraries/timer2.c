@@ -12,6 +12,7 @@
 #include <stdio.h>
 #include <ctype.h>
 #include <avr/io.h>
+#include <util/atomic.h>
 #include "timer2.h"
 
 #define sbi(var, mask)   ((var) |= (uint8_t)(1 << mask))
@@ -19,29 +20,100 @@
 
 volatile unsigned long elapsedMillis;
 
-//Description: Initializes timer 2 for 8 MHz timer and enables overflow interrupts
-// TODO: Make this function use the F_CPU variable to configure the timer.
+#if TIMER2_TICK_REMAINDER
+//How far (in Q16 ticks) the compare periods are behind the millisecond count
+volatile unsigned long timer2Shortfall;
+#endif
+
+//Description: Initializes timer 2 as the 1 ms timebase (CTC mode, prescaler picked from F_CPU in timer2.h) and enables the compare match A interrupt
 void timer2Init(void)
 {
-	//Set the initial timer value so the overflow interrupts will trigger at 1ms.
-	TCNT2 = 5;
+	TCCR2B = 0;		//Stop the timer while it is reconfigured
+	TCNT2 = 0;
+	OCR2A = TIMER2_TOP;	//The count goes 0 to TIMER2_TOP, then starts again
+	TCCR2A = (1<<WGM21);	//CTC mode with OCR2A as TOP
+	TIFR2 = (1<<OCF2A)|(1<<TOV2);	//Clear any stale flags
+	sbi(TIMSK2, OCIE2A);	//Enable the compare match A interrupt
+	TCCR2B = TIMER2_CLOCK_SELECT; 	//Start the timer
+}
 
-	// Init timer 2
-	//Set Prescaler to 1. (Timer Frequency set to F_CPU)
-	TCCR2B = ((1<<CS20)|(1<<CS21)); 	//Divde clock by 32
-	sbi(TIMSK2, TOIE2);	//Enable Timer Overflow interrupts;
+//Description: Reads the millisecond count and the time since that millisecond started as one consistent pair.
+// If the count has passed TOP but the interrupt hasn't run yet (interrupts are off), the pending millisecond is included.
+//Parameters: milliseconds - filled in with the millisecond count
+//			  ticks - filled in with the timer 2 ticks (Q8) since the millisecond started. Can be negative when F_CPU
+//			  doesn't make a whole number of ticks per millisecond (see timer2Tick).
+static void readTimebase(unsigned long* milliseconds, long* ticks)
+{
+	unsigned char count;
+	
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+		*milliseconds = elapsedMillis;
+		count = TCNT2;
+		//The flag is set while the count is at TOP, so a count below TOP means it has already wrapped
+		if((TIFR2 & (1<<OCF2A)) && (count < TIMER2_TOP))(*milliseconds)++;
+		*ticks = (long)count << 8;
+#if TIMER2_TICK_REMAINDER
+		*ticks -= timer2Shortfall >> 8;
+#endif
+	}
 }
 
-//General short delays
+//Description: Waits for x milliseconds
 void delayMs(uint16_t x)
 {
-    unsigned long delay = millis() + x;
-	while(millis() < delay);
+	unsigned long start = millis();
+	
+	while(millis() - start < x);
+}
+
+//Description: Waits for at least x microseconds, in steps of one timer 2 tick (4 us at 8 and 16 MHz).
+// The timer 2 count is followed directly, so this also works while interrupts are off.
+void delayUs(uint16_t x)
+{
+	//Round up to whole ticks, plus one because the first one may already be nearly over
+	unsigned int wait = (((unsigned long)x * TIMER2_TICKS_PER_US_Q16 + 0xFFFF) >> 16) + 1;
+	unsigned int elapsed = 0;
+	unsigned char last = TCNT2, now;
+	
+	while(elapsed < wait){
+		now = TCNT2;
+		if(now < last)elapsed += now + (TIMER2_TOP + 1) - last;
+		else elapsed += now - last;
+		last = now;
+	}
 }
 
 //Description: Returns the elapsed milliseconds since the device was powered up
 // Maximum value ~ 1193 hours, or 49 days
 unsigned long millis(void)
 {
-	return elapsedMillis;
-}
\ No newline at end of file
+	unsigned long milliseconds;
+	
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+		milliseconds = elapsedMillis;
+	}
+	return milliseconds;
+}
+
+//Description: Returns the elapsed microseconds since the device was powered up, with a resolution of one timer 2 tick.
+// Wraps around after ~71 minutes, so use the difference between two readings.
+unsigned long micros(void)
+{
+	unsigned long milliseconds;
+	long ticks;
+	
+	readTimebase(&milliseconds, &ticks);
+	return milliseconds * 1000 + ((ticks * TIMER2_US_PER_TICK_Q8) >> 16);
+}
+
+//Description: Returns a free running count of timer 2 ticks (TIMER2_TICKS_PER_MS per millisecond) for timing short
+// stretches of code. The count wraps every 65536 ticks, so only the difference between two readings means anything.
+//Usage: start = timer2Ticks(); ... elapsed = timer2Ticks() - start;
+unsigned int timer2Ticks(void)
+{
+	unsigned long milliseconds;
+	long ticks;
+	
+	readTimebase(&milliseconds, &ticks);
+	return (unsigned int)milliseconds * TIMER2_TICKS_PER_MS + (int)(ticks >> 8);
+}
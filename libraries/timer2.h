@@ -8,9 +8,81 @@
 *  of total program duration, setting delays
 *  and alarms.
 **********************************************/
+//Timer 2 is cleared on compare match A every millisecond. The hardware restarts the count, so the
+//millisecond doesn't drift with the interrupt latency. The smallest prescaler that fits a millisecond
+//in the 8 bit counter is picked at compile time from F_CPU (8 MHz / 32 and 16 MHz / 64 = 250 ticks per ms).
+#if (F_CPU) / 1000 <= 255
+#define TIMER2_PRESCALER	1
+#define TIMER2_CLOCK_SELECT	(1<<CS20)
+#elif (F_CPU) / 8000 <= 255
+#define TIMER2_PRESCALER	8
+#define TIMER2_CLOCK_SELECT	(1<<CS21)
+#elif (F_CPU) / 32000 <= 255
+#define TIMER2_PRESCALER	32
+#define TIMER2_CLOCK_SELECT	((1<<CS21)|(1<<CS20))
+#elif (F_CPU) / 64000 <= 255
+#define TIMER2_PRESCALER	64
+#define TIMER2_CLOCK_SELECT	(1<<CS22)
+#elif (F_CPU) / 128000 <= 255
+#define TIMER2_PRESCALER	128
+#define TIMER2_CLOCK_SELECT	((1<<CS22)|(1<<CS20))
+#elif (F_CPU) / 256000 <= 255
+#define TIMER2_PRESCALER	256
+#define TIMER2_CLOCK_SELECT	((1<<CS22)|(1<<CS21))
+#else
+#error F_CPU is too fast for the timer 2 millisecond timebase
+#endif
+
+#if (F_CPU) % TIMER2_PRESCALER
+#error F_CPU must be a whole multiple of the timer 2 prescaler
+#endif
+
+//Timer 2 count rate in Hz, and the whole number of ticks in a millisecond
+#define TIMER2_CLOCK	((F_CPU) / TIMER2_PRESCALER)
+#define TIMER2_TICKS_PER_MS	(TIMER2_CLOCK / 1000)
+#define TIMER2_TOP	(TIMER2_TICKS_PER_MS - 1)
+//When a millisecond isn't a whole number of ticks (i.e. 156.25 at 20 MHz) every compare period is
+//TIMER2_TICK_REMAINDER thousandths of a tick short of a millisecond. TOP can't be changed safely from
+//the interrupt (the count is still at TOP when it runs), so instead the shortfall is added up in Q16 ticks
+//and each time it reaches a whole compare period one compare match is not counted as a millisecond.
+#define TIMER2_TICK_REMAINDER	(TIMER2_CLOCK % 1000)
+#define TIMER2_SHORTFALL_Q16	(((unsigned long)TIMER2_TICK_REMAINDER * 65536UL + 500) / 1000)
+#define TIMER2_PERIOD_Q16	((unsigned long)TIMER2_TICKS_PER_MS << 16)
+
+#if TIMER2_TICKS_PER_MS < 100
+#error F_CPU is too slow for the timer 2 millisecond timebase
+#endif
+
+//Microseconds per tick (Q8) and ticks per microsecond (Q16), used to convert without a division
+#define TIMER2_US_PER_TICK_Q8	((256000000UL + TIMER2_CLOCK/2) / TIMER2_CLOCK)
+#define TIMER2_TICKS_PER_US_Q16	((TIMER2_CLOCK * 8192UL + 62500UL) / 125000UL)
+
 void timer2Init(void);
+unsigned int timer2Ticks(void);
 void delayMs(uint16_t x);
 void delayUs(uint16_t x);
 unsigned long millis(void);
+unsigned long micros(void);
+
+//Incremented by timer2Tick, which the main program has to call from TIMER2_COMPA_vect. Read it through millis().
+extern volatile unsigned long elapsedMillis;
+#if TIMER2_TICK_REMAINDER
+extern volatile unsigned long timer2Shortfall;
+#endif
 
-extern volatile unsigned long elapsedMillis;
\ No newline at end of file
+//Description: Counts a millisecond. Must be called from TIMER2_COMPA_vect (inline, so the ISR doesn't have to save every register).
+//Note: When F_CPU makes a millisecond a whole number of ticks this is just the increment.
+static inline void timer2Tick(void)
+{
+#if TIMER2_TICK_REMAINDER
+	unsigned long shortfall = timer2Shortfall + TIMER2_SHORTFALL_Q16;
+	
+	if(shortfall >= TIMER2_PERIOD_Q16){
+		//The compare periods have fallen a whole period behind the millisecond count, so let them catch up
+		timer2Shortfall = shortfall - TIMER2_PERIOD_Q16;
+		return;
+	}
+	timer2Shortfall = shortfall;
+#endif
+	elapsedMillis++;
+}
@@ -0,0 +1,124 @@
+/*********************************************************
+* Triggered Capture Library
+* Keeps a history of the most recent samples and captures
+* an event when the acceleration crosses a threshold.
+*********************************************************/
+#include "trigger.h"
+
+//Description: Sets up a capture and resets it. The samples before and after the trigger are cut down to fit in the history
+// (the samples after the trigger are kept first).
+//Inputs: mode - TRIGGER_AXIS or TRIGGER_MAGNITUDE
+//		  axes - number of values in each sample (1 to 3)
+//		  threshold - in hundredths of a g
+//		  preSamples, postSamples - the samples sent from before the trigger, and from the trigger on (at least 1)
+//Usage: triggerInit(&capture, TRIGGER_MAGNITUDE, 3, 200, 8, 24);	//Events of 32 samples when the magnitude reaches 2g
+void triggerInit(struct triggerCapture* capture, unsigned char mode, unsigned char axes, int threshold, unsigned char preSamples, unsigned char postSamples)
+{
+	capture->mode = mode;
+	capture->axes = axes;
+	capture->capacity = TRIGGER_BUFFER_SIZE / axes;
+	if(postSamples < 1)postSamples = 1;
+	if(postSamples > capture->capacity)postSamples = capture->capacity;
+	if(preSamples > capture->capacity - postSamples)preSamples = capture->capacity - postSamples;
+	capture->preSamples = preSamples;
+	capture->postSamples = postSamples;
+	capture->threshold = threshold;
+	capture->thresholdSquared = (long)threshold * threshold;
+	capture->event = 0;
+	triggerReset(capture);
+}
+
+//Description: Empties the history (i.e. after a range switch, or once an event has been sent).
+// The capture is armed again once the samples that go before the trigger have been collected.
+void triggerReset(struct triggerCapture* capture)
+{
+	capture->head = 0;
+	capture->count = 0;
+	capture->sent = 0;
+	capture->state = (capture->preSamples > 0) ? TRIGGER_FILLING : TRIGGER_ARMED;
+}
+
+//Description: Checks a sample against the threshold while the capture is armed. Call before triggerAddSample,
+// so the sample that crosses the threshold is the first one after the trigger.
+//Inputs: centiG - the acceleration of each axis in hundredths of a g
+//		  now - the current time in ms (i.e. millis()), kept as the time of the event
+//Return: 1 if the sample starts an event
+//Usage: if(capture.state == TRIGGER_ARMED)triggerCheck(&capture, axisG, millis());
+char triggerCheck(struct triggerCapture* capture, const int* centiG, unsigned long now)
+{
+	unsigned long magnitude = 0;
+	char crossed = 0;
+	
+	if(capture->state != TRIGGER_ARMED)return 0;
+	for(unsigned char axis=0; axis < capture->axes; axis++){
+		if(capture->mode == TRIGGER_MAGNITUDE)magnitude += (long)centiG[axis] * centiG[axis];
+		else if((centiG[axis] >= capture->threshold) || (centiG[axis] <= -capture->threshold))crossed = 1;
+	}
+	if(capture->mode == TRIGGER_MAGNITUDE)crossed = (magnitude >= capture->thresholdSquared);
+	if(crossed){
+		capture->state = TRIGGER_CAPTURING;
+		capture->count = 0;
+		capture->time = now;
+	}
+	return crossed;
+}
+
+//Description: Adds a sample to the history. Samples are ignored while an event is being sent.
+//Inputs: values - one value for each axis
+//Usage: triggerAddSample(&capture, values);
+void triggerAddSample(struct triggerCapture* capture, const unsigned int* values)
+{
+	unsigned int* slot;
+	
+	if(capture->state == TRIGGER_SENDING)return;
+	slot = &capture->history[capture->head * capture->axes];
+	for(unsigned char axis=0; axis < capture->axes; axis++)slot[axis] = values[axis];
+	if(++capture->head >= capture->capacity)capture->head = 0;
+	
+	if(capture->state == TRIGGER_FILLING){
+		if(++capture->count >= capture->preSamples)capture->state = TRIGGER_ARMED;
+	}
+	else if(capture->state == TRIGGER_CAPTURING){
+		if(++capture->count >= capture->postSamples)capture->state = TRIGGER_SENDING;
+	}
+}
+
+//Description: Builds the payload of the next FRAME_TYPE_EVENT frame of a captured event (see frame.h), oldest samples first.
+// The capture starts filling again for the next event once the last frame has been built.
+//Outputs: buffer - at least TRIGGER_MAX_PAYLOAD(axes) bytes
+//Return: The payload length, 0 if there is no event to send
+//Usage: if(capture.state == TRIGGER_SENDING)outputFrame(FRAME_TYPE_EVENT, sequence++, buffer, triggerFrame(&capture, buffer));
+unsigned char triggerFrame(struct triggerCapture* capture, unsigned char* buffer)
+{
+	unsigned char total = capture->preSamples + capture->postSamples;
+	unsigned char samples = total - capture->sent, slot, length;
+	unsigned int* values;
+	
+	if(capture->state != TRIGGER_SENDING)return 0;
+	if(samples > TRIGGER_FRAME_SAMPLES)samples = TRIGGER_FRAME_SAMPLES;
+	
+	buffer[0] = capture->event >> 8;
+	buffer[1] = capture->event;
+	buffer[2] = capture->sent;
+	buffer[3] = capture->preSamples;
+	buffer[4] = total;
+	length = TRIGGER_HEADER_SIZE;
+	
+	//The history ends with the last sample of the event, so the event starts total samples before head
+	slot = (capture->head + capture->capacity - total + capture->sent) % capture->capacity;
+	for(unsigned char sample=0; sample < samples; sample++){
+		values = &capture->history[slot * capture->axes];
+		for(unsigned char axis=0; axis < capture->axes; axis++){
+			buffer[length++] = values[axis] >> 8;
+			buffer[length++] = values[axis];
+		}
+		if(++slot >= capture->capacity)slot = 0;
+	}
+	
+	capture->sent += samples;
+	if(capture->sent >= total){
+		capture->event++;
+		triggerReset(capture);
+	}
+	return length;
+}
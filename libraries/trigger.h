@@ -0,0 +1,63 @@
+/*********************************************************
+* Triggered Capture Library Header File
+* Keeps a history of the most recent samples and captures
+* an event when the acceleration crosses a threshold: the
+* samples from before the trigger and the samples after
+* it are sent together as FRAME_TYPE_EVENT frames (see
+* frame.h), and nothing is sent between events.
+*********************************************************/
+//Trigger modes
+#define TRIGGER_OFF	0	//Measurement mode streams the samples in the output mode
+#define TRIGGER_AXIS	1	//An event starts when any enabled axis reads at least the threshold (either direction)
+#define TRIGGER_MAGNITUDE	2	//An event starts when the vector magnitude of the enabled axis is at least the threshold
+#define NUM_TRIGGER_MODES	3
+
+//Size of the sample history in values (samples * enabled axis), so 32 samples of 3 axis or 96 of one.
+//The history is the largest single user of the ATmega328's 2 kB of RAM, so it is kept small enough to leave
+//room for the stack. Can be overridden from the Makefile (i.e. CDEFS += -DTRIGGER_BUFFER_SIZE=48)
+#ifndef TRIGGER_BUFFER_SIZE
+#define TRIGGER_BUFFER_SIZE	96
+#endif
+#if TRIGGER_BUFFER_SIZE > 255
+#error TRIGGER_BUFFER_SIZE must be no larger than 255, the sample counts in the event frames are single bytes
+#endif
+
+//Samples in each FRAME_TYPE_EVENT frame, after a header of event number (2), index of the first sample in the frame (1),
+//number of samples before the trigger (1) and number of samples in the event (1)
+#define TRIGGER_FRAME_SAMPLES	16
+#define TRIGGER_HEADER_SIZE	5
+#define TRIGGER_MAX_PAYLOAD(axes)	(TRIGGER_HEADER_SIZE + 2 * (axes) * TRIGGER_FRAME_SAMPLES)
+
+//Rough number of main loop CPU cycles the threshold check and the history take for each value (one axis of one sample).
+//Used to keep the sample rate within what the main loop can check. Counted from the code, not measured on the hardware.
+#define TRIGGER_CYCLES	150
+
+//Capture states
+#define TRIGGER_FILLING	0	//Waiting for the samples that go before the trigger
+#define TRIGGER_ARMED	1	//Checking every sample against the threshold
+#define TRIGGER_CAPTURING	2	//Collecting the samples after the trigger
+#define TRIGGER_SENDING	3	//The event is being sent, the history is left alone until it has gone
+
+//Description: State of a triggered capture. Set up by triggerInit.
+struct triggerCapture{
+	unsigned char mode;			//TRIGGER_AXIS or TRIGGER_MAGNITUDE
+	unsigned char axes;			//Number of values in each sample
+	unsigned char state;		//TRIGGER_...
+	unsigned char capacity;		//Number of samples the history holds
+	unsigned char preSamples;	//Samples sent from before the trigger
+	unsigned char postSamples;	//Samples sent from the trigger on (including the one that crossed the threshold)
+	unsigned char head;			//History slot the next sample goes in
+	unsigned char count;		//Samples stored while filling, or collected since the trigger
+	unsigned char sent;			//Samples of the event sent so far
+	int threshold;				//In hundredths of a g
+	unsigned long thresholdSquared;	//For TRIGGER_MAGNITUDE
+	unsigned int event;			//Number of the event being captured, counts up from 0
+	unsigned long time;			//When the trigger sample arrived (in ms)
+	unsigned int history[TRIGGER_BUFFER_SIZE];
+};
+
+void triggerInit(struct triggerCapture* capture, unsigned char mode, unsigned char axes, int threshold, unsigned char preSamples, unsigned char postSamples);
+void triggerReset(struct triggerCapture* capture);
+char triggerCheck(struct triggerCapture* capture, const int* centiG, unsigned long now);
+void triggerAddSample(struct triggerCapture* capture, const unsigned int* values);
+unsigned char triggerFrame(struct triggerCapture* capture, unsigned char* buffer);
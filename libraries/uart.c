@@ -10,33 +10,230 @@
 #include <stdio.h>
 #include <ctype.h>
 #include <avr/io.h>
-#include <math.h>
+#include <avr/interrupt.h>
+#include <avr/sleep.h>
 #include "uart.h"
 
+//printf output goes through uartPutchar (set up by uartInit)
+static FILE mystdout = FDEV_SETUP_STREAM(uartPutchar, NULL, _FDEV_SETUP_WRITE);
+
+//Transmit ring buffer. The main program adds characters at txHead and the
+//USART Data Register Empty interrupt removes them from txTail.
+static volatile char txBuffer[UART_TX_BUFFER_SIZE];
+static volatile unsigned char txHead=0, txTail=0;
+//Set once a character has been handed to the UART, so uartFlush knows whether to wait for TXC0
+static volatile unsigned char txStarted=0;
+
+volatile unsigned char uartTxHighWater=0;
+volatile unsigned int uartTxOverflows=0;
+
+//Receive ring buffer. The USART Receive Complete interrupt adds characters at rxHead
+//and the main program removes them from rxTail.
+static volatile char rxBuffer[UART_RX_BUFFER_SIZE];
+static volatile unsigned char rxHead=0, rxTail=0;
+
+volatile unsigned int uartRxOverflows=0;
+volatile unsigned int uartRxOverruns=0;
+
+//Description: Moves the next character in the transmit buffer to the UART. Disables the interrupt once the buffer is empty.
+//Note: Shared by the UDRE interrupt and the polled path used when global interrupts are off.
+static inline void txSendNext(void)
+{
+	unsigned char tail = txTail;
+	
+	if(tail == txHead){
+		UCSR0B &= ~(1<<UDRIE0);	//Nothing left to send
+		return;
+	}
+	UCSR0A = (UCSR0A & (1<<U2X0)) | (1<<TXC0);	//Clear the transmit complete flag so uartFlush can wait on it
+	UDR0 = txBuffer[tail];
+	txTail = (tail + 1) & UART_TX_BUFFER_MASK;
+	txStarted = 1;
+}
+
+//Description: Adds a character to the transmit buffer if there is room.
+//Returns: 1 if the character was queued, 0 if the buffer was full
+static char txEnqueue(char c)
+{
+	unsigned char head = txHead;
+	unsigned char next = (head + 1) & UART_TX_BUFFER_MASK;
+	unsigned char used;
+	
+	if(next == txTail)return 0;
+	txBuffer[head] = c;
+	txHead = next;
+	
+	used = (next - txTail) & UART_TX_BUFFER_MASK;
+	if(used > uartTxHighWater)uartTxHighWater = used;
+	
+	UCSR0B |= (1<<UDRIE0);	//Make sure the transmit interrupt is running
+	return 1;
+}
+
+//Description: If global interrupts are disabled the buffer can't drain by itself, so feed the UART by hand.
+static void txPoll(void)
+{
+	if(!(SREG & (1<<SREG_I)) && (UCSR0A & (1<<UDRE0)))txSendNext();
+}
+
+ISR(USART_UDRE_vect)
+{
+	txSendNext();
+}
+
+//Description: Stores a received character in the receive buffer. Characters that arrive while the buffer is full are dropped.
+//Note: Shared by the receive interrupt and the polled path used when global interrupts are off.
+static inline void rxStore(void)
+{
+	char c;
+	unsigned char next = (rxHead + 1) & UART_RX_BUFFER_MASK;
+	
+	//The data overrun flag belongs to the character in UDR0, so it has to be checked before UDR0 is read
+	if(UCSR0A & (1<<DOR0))uartRxOverruns++;
+	c = UDR0;	//Always read UDR0 to clear the receive flag
+	if(next == rxTail){
+		uartRxOverflows++;
+		return;
+	}
+	rxBuffer[rxHead] = c;
+	rxHead = next;
+}
+
+ISR(USART_RX_vect)
+{
+	rxStore();
+}
+
+//Description: Finds the UBRR value with the lowest baud rate error, trying both normal (16 samples per bit)
+// and double speed (8 samples per bit) modes. Normal mode is used if both are equally good, since the
+// receiver tolerates more error in normal mode. Only integer math is used.
+//Inputs: baudRate - the desired baud rate
+//		  ubrr - set to the UBRR value
+//		  doubleSpeed - set to 1 if U2X0 should be set
+//Return: The baud rate error in tenths of a percent
+//Usage: error = uartBaudSetting(250000, &ubrr, &doubleSpeed);
 //Expects F_CPU to be defined as the system clock frequency (in Hz) in the Makefile
+unsigned int uartBaudSetting(unsigned long baudRate, unsigned int* ubrr, char* doubleSpeed)
+{
+	unsigned long divisor, setting, actual, difference;
+	unsigned int error, bestError=0xFFFF;
+	
+	*ubrr = 0;
+	*doubleSpeed = 0;
+	if(baudRate == 0)return bestError;
+	
+	for(char mode=0; mode < 2; mode++){
+		divisor = (mode ? 8 : 16) * baudRate;
+		setting = (F_CPU + divisor/2) / divisor;	//UBRR + 1, rounded to the nearest value
+		if(setting == 0)continue;	//Too fast for this mode
+		if(setting > 4096)setting = 4096;	//UBRR is 12 bits
+		
+		actual = F_CPU / ((mode ? 8 : 16) * setting);
+		difference = (actual > baudRate) ? (actual - baudRate) : (baudRate - actual);
+		error = (difference * 1000) / baudRate;
+		if(error < bestError){
+			bestError = error;
+			*ubrr = setting - 1;
+			*doubleSpeed = mode;
+		}
+	}
+	return bestError;
+}
+
+//Description: Sets up the UART for 8 bit characters at the given baud rate
+//Return: The UBRR value, or -1 if the baud rate can't be made within UART_MAX_BAUD_ERROR (the UART is left unchanged)
+//Usage: uartInit(38400);
 int uartInit(unsigned long baudRate){
-	//This equation needs to be fixed
-	unsigned int myUbrr = (unsigned int)round((double)((F_CPU/16)/(double)baudRate*2-1));
+	unsigned int myUbrr;
+	char doubleSpeed;
+	
+	if(uartBaudSetting(baudRate, &myUbrr, &doubleSpeed) > UART_MAX_BAUD_ERROR)return -1;
 	
-	UBRR0H = (myUbrr >> 8) & 0x7F;	//Make sure highest bit(URSEL) is 0 indicating we are writing to UBRRH
+	//Let anything still in the transmit buffer go out at the old baud rate
+	if(UCSR0B & (1<<TXEN0))uartFlush();
+	
+	UBRR0H = (myUbrr >> 8) & 0x0F;	//Only the lower 4 bits of UBRR0H are used
 	UBRR0L = myUbrr;
-	UCSR0A = (1<<U2X0);					//Double the UART Speed
-	UCSR0B = (1<<RXEN0)|(1<<TXEN0);		//Enable Rx and Tx in UART
+	UCSR0A = doubleSpeed ? (1<<U2X0) : 0;	//Double the UART Speed if that gives the lower error
+	UCSR0B = (1<<RXCIE0)|(1<<RXEN0)|(1<<TXEN0);		//Enable Rx and Tx in UART, and the receive interrupt
 	UCSR0C = (1<<UCSZ00)|(1<<UCSZ01);		//8-Bit Characters
 	stdout = &mystdout; //Required for printf init
 
 	return myUbrr;
 }
 
+//Description: Adds a character to the transmit buffer without waiting.
+//Returns: 1 if the character was queued, 0 if the buffer was full (the character is dropped and counted in uartTxOverflows)
+//Usage: if(!uartWriteChar('#'))droppedFrames++;
+char uartWriteChar(char c)
+{
+	if(txEnqueue(c))return 1;
+	uartTxOverflows++;
+	return 0;
+}
+
+//Description: Returns the number of characters that can be queued before the transmit buffer is full
+unsigned char uartTxFree(void)
+{
+	return (txTail - txHead - 1) & UART_TX_BUFFER_MASK;
+}
+
+//Description: Waits until every queued character has been shifted out of the UART
+void uartFlush(void)
+{
+	while(txHead != txTail)txPoll();
+	if(txStarted)loop_until_bit_is_set(UCSR0A, TXC0);
+}
+
+//Description: stdio output routine. Waits for room in the transmit buffer so printf output is never lost.
 int uartPutchar(char c, FILE *stream)
-{ 
-  loop_until_bit_is_set(UCSR0A, UDRE0);
-  UDR0 = c;
-  return 0;
+{
+	while(!txEnqueue(c))txPoll();
+	return 0;
 }
 
+//Description: Waits for a character to arrive and returns it
+//Note: The CPU idles between interrupts while waiting (if interrupts are enabled), the receive interrupt wakes it up.
 uint8_t uartGetChar(void)
 {
-    while( !(UCSR0A & (1<<RXC0)) );
-	return(UDR0);
-}
\ No newline at end of file
+	while(rxHead == rxTail){
+		if(SREG & (1<<SREG_I))sleep_mode();
+		else if(UCSR0A & (1<<RXC0))rxStore();
+	}
+	return uartReadChar();
+}
+
+//Description: Returns the number of received characters waiting in the receive buffer
+unsigned char uartAvailable(void)
+{
+	return (rxHead - rxTail) & UART_RX_BUFFER_MASK;
+}
+
+//Description: Removes the oldest character from the receive buffer without waiting
+//Returns: The character, or -1 if nothing has been received
+int uartReadChar(void)
+{
+	unsigned char tail = rxTail;
+	char c;
+	
+	if(tail == rxHead)return -1;
+	c = rxBuffer[tail];
+	rxTail = (tail + 1) & UART_RX_BUFFER_MASK;
+	return (unsigned char)c;
+}
+
+//Description: Returns the oldest character in the receive buffer without removing it
+//Returns: The character, or -1 if nothing has been received
+int uartPeekChar(void)
+{
+	unsigned char tail = rxTail;
+	
+	if(tail == rxHead)return -1;
+	return (unsigned char)rxBuffer[tail];
+}
+
+//Description: Throws away everything in the receive buffer
+void uartRxClear(void)
+{
+	rxTail = rxHead;
+}
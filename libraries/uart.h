@@ -6,7 +6,60 @@
 * Written by Ryan Owens
 * 6/15/11
 *********************************************************/
+//Size of the transmit ring buffer in bytes. Must be a power of 2 (and no larger than 256)
+//Can be overridden from the Makefile (i.e. CDEFS += -DUART_TX_BUFFER_SIZE=64)
+#ifndef UART_TX_BUFFER_SIZE
+#define UART_TX_BUFFER_SIZE	128
+#endif
+#define UART_TX_BUFFER_MASK	(UART_TX_BUFFER_SIZE - 1)
+
+#if (UART_TX_BUFFER_SIZE & UART_TX_BUFFER_MASK) || (UART_TX_BUFFER_SIZE > 256)
+#error UART_TX_BUFFER_SIZE must be a power of 2 no larger than 256
+#endif
+
+//Size of the receive ring buffer in bytes. Must be a power of 2 (and no larger than 256)
+#ifndef UART_RX_BUFFER_SIZE
+#define UART_RX_BUFFER_SIZE	32
+#endif
+#define UART_RX_BUFFER_MASK	(UART_RX_BUFFER_SIZE - 1)
+
+#if (UART_RX_BUFFER_SIZE & UART_RX_BUFFER_MASK) || (UART_RX_BUFFER_SIZE > 256)
+#error UART_RX_BUFFER_SIZE must be a power of 2 no larger than 256
+#endif
+
+//Largest baud rate error (in tenths of a percent) uartInit will accept.
+//115200 baud at 8 MHz is 3.5% slow, which the original firmware has always used, so the default allows it.
+#ifndef UART_MAX_BAUD_ERROR
+#define UART_MAX_BAUD_ERROR	40
+#endif
+
+//Compile time UBRR values (rounded to the nearest setting), for when the baud rate is a constant.
+//i.e. UBRR0 = UART_UBRR_U2X(250000);
+#define UART_UBRR_NORMAL(baud)	((((F_CPU) + 8UL * (baud)) / (16UL * (baud))) - 1)
+#define UART_UBRR_U2X(baud)	((((F_CPU) + 4UL * (baud)) / (8UL * (baud))) - 1)
+//Error of those settings in tenths of a percent, for compile time checks (i.e. #if UART_ERROR_U2X(38400) > UART_MAX_BAUD_ERROR)
+#define UART_ERROR_NORMAL(baud)	UART_ERROR_TENTHS((F_CPU) / (16UL * (UART_UBRR_NORMAL(baud) + 1)), baud)
+#define UART_ERROR_U2X(baud)	UART_ERROR_TENTHS((F_CPU) / (8UL * (UART_UBRR_U2X(baud) + 1)), baud)
+#define UART_ERROR_TENTHS(actual, baud)	((((actual) > (baud)) ? ((actual) - (baud)) : ((baud) - (actual))) * 1000 / (baud))
+
 int uartInit(unsigned long baudRate);
+unsigned int uartBaudSetting(unsigned long baudRate, unsigned int* ubrr, char* doubleSpeed);
 int uartPutchar(char c, FILE *stream);
+char uartWriteChar(char c);
+unsigned char uartTxFree(void);
+void uartFlush(void);
 uint8_t uartGetChar(void);
-static FILE mystdout = FDEV_SETUP_STREAM(uartPutchar, NULL, _FDEV_SETUP_WRITE);
\ No newline at end of file
+unsigned char uartAvailable(void);
+int uartReadChar(void);
+int uartPeekChar(void);
+void uartRxClear(void);
+
+//Transmit buffer statistics. uartTxHighWater is the largest number of bytes that have been
+//waiting in the buffer, uartTxOverflows counts the bytes rejected by uartWriteChar because the buffer was full.
+extern volatile unsigned char uartTxHighWater;
+extern volatile unsigned int uartTxOverflows;
+
+//Number of received characters that were thrown away because the receive buffer was full
+extern volatile unsigned int uartRxOverflows;
+//Number of times the USART lost characters because the receive interrupt didn't read UDR0 in time (DOR0)
+extern volatile unsigned int uartRxOverruns;
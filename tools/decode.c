@@ -0,0 +1,244 @@
+/*********************************************************
+* Reference Frame Decoder
+* Reads the binary frames sent by the framed output modes
+* (framed, burst, packed and delta compressed) from a file
+* or stdin, checks them and prints one sample per line:
+*	sequence	timestamp	x	y	z
+* Axis that were left out of the frame (see FRAME_AXES_SHIFT)
+* are printed as '-'.
+* Lost frames (sequence gaps) and CRC errors are counted
+* and reported on stderr at the end. Status frames and
+* command replies are printed on stderr as they arrive, and
+* so is the start of each triggered event. Every sample of
+* an event has the time of its trigger.
+*
+* Build on the host PC with: make decoder
+* Usage: tools/decode < capture.bin
+*		 tools/decode /dev/ttyUSB0
+*********************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include "crc16.h"
+#include "delta.h"
+#include "frame.h"
+#include "command.h"
+
+#define MAX_SAMPLES	255
+
+//Description: Running totals for the end of stream report
+struct decodeStatistics{
+	unsigned long frames;
+	unsigned long samples;
+	unsigned long lostFrames;
+	unsigned long crcErrors;
+	unsigned long badFrames;
+};
+
+//Description: Unpacks 10 bit values from a FRAME_TYPE_PACKED payload
+//Return: The number of complete samples of axes values unpacked
+static int unpackSamples(const unsigned char* payload, unsigned char length, unsigned int* samples, int axes)
+{
+	unsigned long bits=0;
+	int bitCount=0, values=0;
+	
+	for(int i=0; i < length; i++){
+		bits = (bits << 8) | payload[i];
+		bitCount += 8;
+		if(bitCount >= 10){
+			bitCount -= 10;
+			samples[values++] = (bits >> bitCount) & 0x3FF;
+		}
+	}
+	return values / axes;
+}
+
+//Description: Reads a big endian value from a frame payload
+static unsigned long getBigEndian(const unsigned char* payload, int size)
+{
+	unsigned long value=0;
+	
+	while(size--)value = (value << 8) | *payload++;
+	return value;
+}
+
+//Description: Prints the performance counters from a FRAME_TYPE_STATUS frame on stderr, so they don't mix with the samples
+static void printStatus(unsigned long timestamp, const unsigned char* payload, unsigned char length, struct decodeStatistics* statistics)
+{
+	unsigned long conversions, isrTicks, period;
+	
+	if(length < 28){
+		statistics->badFrames++;
+		return;
+	}
+	conversions = getBigEndian(&payload[0], 4);
+	isrTicks = getBigEndian(&payload[22], 4);
+	//The firmware sends timer 1 TOP, the period is one tick more
+	period = getBigEndian(&payload[26], 2) + 1;
+	fprintf(stderr, "status at %lu ms: %lu conversions, %lu frames sent, %lu frames dropped, %lu samples dropped, "
+		"TX high water %lu, %lu TX overflows, %lu RX overflows, %lu RX overruns, longest loop %lu ticks, ISR load %.1f%%\n",
+		timestamp, conversions, getBigEndian(&payload[4], 4), getBigEndian(&payload[8], 2), getBigEndian(&payload[10], 2),
+		getBigEndian(&payload[12], 2), getBigEndian(&payload[14], 2), getBigEndian(&payload[16], 2), getBigEndian(&payload[18], 2),
+		getBigEndian(&payload[20], 2), conversions ? 100.0 * isrTicks / ((double)conversions * period) : 0.0);
+}
+
+//Description: Prints a FRAME_TYPE_REPLY frame (the answer to a binary command, see command.h) on stderr
+static void printReply(unsigned long timestamp, const unsigned char* payload, unsigned char length, struct decodeStatistics* statistics)
+{
+	if(length < 2){
+		statistics->badFrames++;
+		return;
+	}
+	fprintf(stderr, "reply at %lu ms: command 0x%02X, result %u", timestamp, payload[0], payload[1]);
+	if((payload[0] != COMMAND_GET_STATUS) && (length >= 16)){
+		fprintf(stderr, ", range %u, mode %u, %lu Hz (up to %lu), baud %u, average shift %u, extra resolution %u, burst %u, "
+			"ADC clock %u, discard %u, axis mask 0x%X, %s", payload[2], payload[3], getBigEndian(&payload[4], 2), getBigEndian(&payload[14], 2),
+			payload[6], payload[7], payload[8], payload[9], payload[10], payload[11], payload[12], payload[13] ? "measuring" : "stopped");
+		//Firmware with the decimation filters adds the filter settings
+		if(length >= 20)fprintf(stderr, ", filter %u, filter shift %u, cutoff %lu Hz", payload[16], payload[17], getBigEndian(&payload[18], 2));
+		//and then the trigger settings
+		if(length >= 25)fprintf(stderr, ", trigger %u, threshold %lu, %u + %u samples", payload[20], getBigEndian(&payload[21], 2), payload[23], payload[24]);
+	}
+	fprintf(stderr, "\n");
+	if(payload[0] == COMMAND_GET_STATUS)printStatus(timestamp, &payload[2], length - 2, statistics);
+}
+
+//Description: Decodes the payload of one frame and prints its samples
+static void printFrame(unsigned char type, unsigned int sequence, unsigned long timestamp, const unsigned char* payload, unsigned char length, struct decodeStatistics* statistics)
+{
+	unsigned int samples[MAX_SAMPLES * 3];
+	int count=0, axes=0, value;
+	unsigned char axisMask = type >> FRAME_AXES_SHIFT;
+	
+	//No axis mask means all 3 axis. The values are in X, Y, Z order, X is bit 2.
+	if(axisMask == 0)axisMask = 0x07;
+	for(int bit=0; bit < 3; bit++)if(axisMask & (1 << bit))axes++;
+	
+	switch(type & FRAME_TYPE_MASK){
+		case FRAME_TYPE_SAMPLE:
+		case FRAME_TYPE_BURST:
+			count = length / (axes * 2);
+			for(int i=0; i < count * axes; i++)samples[i] = (payload[i*2] << 8) | payload[i*2 + 1];
+			break;
+		case FRAME_TYPE_PACKED:
+			count = unpackSamples(payload, length, samples, axes);
+			break;
+		case FRAME_TYPE_DELTA:
+			count = deltaDecode(payload, length, samples, MAX_SAMPLES, axes);
+			break;
+		case FRAME_TYPE_EVENT:
+			//Event number (2), first sample (1), samples before the trigger (1) and samples in the event (1), then a burst
+			if(length < 5)break;
+			if(payload[2] == 0)fprintf(stderr, "event %lu at %lu ms: %u samples, %u before the trigger\n", getBigEndian(&payload[0], 2), timestamp, payload[4], payload[3]);
+			count = (length - 5) / (axes * 2);
+			for(int i=0; i < count * axes; i++)samples[i] = (payload[5 + i*2] << 8) | payload[5 + i*2 + 1];
+			break;
+		case FRAME_TYPE_STATUS:
+			printStatus(timestamp, payload, length, statistics);
+			return;
+		case FRAME_TYPE_REPLY:
+			printReply(timestamp, payload, length, statistics);
+			return;
+		default:
+			//Not a sample frame, nothing to print
+			return;
+	}
+	if(count <= 0){
+		statistics->badFrames++;
+		return;
+	}
+	for(int i=0; i < count; i++){
+		printf("%u\t%lu", sequence, timestamp);
+		value = i * axes;
+		for(int bit=2; bit >= 0; bit--){
+			if(axisMask & (1 << bit))printf("\t%u", samples[value++]);
+			else printf("\t-");
+		}
+		printf("\n");
+	}
+	statistics->samples += count;
+}
+
+//Description: Input buffer, so the decoder can back up and look for the next sync word when a frame fails its CRC check
+struct inputBuffer{
+	FILE* file;
+	unsigned char data[1024];
+	int start;
+	int end;
+};
+
+//Description: Makes sure at least count bytes are in the buffer after start
+//Return: 1 if they are, 0 at the end of the input
+static int fillBuffer(struct inputBuffer* buffer, int count)
+{
+	size_t got;
+	
+	if(buffer->start > 0){
+		for(int i=buffer->start; i < buffer->end; i++)buffer->data[i - buffer->start] = buffer->data[i];
+		buffer->end -= buffer->start;
+		buffer->start = 0;
+	}
+	while(buffer->end < count){
+		got = fread(&buffer->data[buffer->end], 1, sizeof(buffer->data) - buffer->end, buffer->file);
+		if(got == 0)return 0;
+		buffer->end += got;
+	}
+	return 1;
+}
+
+int main(int argc, char* argv[])
+{
+	static struct inputBuffer buffer;
+	struct decodeStatistics statistics = {0};
+	unsigned char* frame;
+	unsigned char length;
+	unsigned int sequence, expectedSequence=0;
+	unsigned long timestamp;
+	uint16_t crc;
+	int haveSequence=0;
+	
+	buffer.file = stdin;
+	if(argc > 1){
+		buffer.file = fopen(argv[1], "rb");
+		if(buffer.file == NULL){
+			perror(argv[1]);
+			return 1;
+		}
+	}
+	
+	while(fillBuffer(&buffer, FRAME_HEADER_SIZE)){
+		frame = &buffer.data[buffer.start];
+		//Look for the sync word, anything else is skipped
+		if((frame[0] != FRAME_SYNC1) || (frame[1] != FRAME_SYNC2)){
+			buffer.start++;
+			continue;
+		}
+		length = frame[3];
+		if(!fillBuffer(&buffer, FRAME_OVERHEAD + length))break;
+		frame = &buffer.data[buffer.start];
+		
+		//The CRC covers everything from the type byte to the end of the payload
+		crc = CRC16_INIT;
+		for(int i=2; i < FRAME_HEADER_SIZE + length; i++)crc = crc16Update(crc, frame[i]);
+		if(crc != ((frame[FRAME_HEADER_SIZE + length] << 8) | frame[FRAME_HEADER_SIZE + length + 1])){
+			//Could be a sync word inside another frame, so start looking again right after this sync word
+			statistics.crcErrors++;
+			buffer.start += 2;
+			continue;
+		}
+		
+		sequence = (frame[4] << 8) | frame[5];
+		timestamp = ((unsigned long)frame[6] << 24) | ((unsigned long)frame[7] << 16) | (frame[8] << 8) | frame[9];
+		if(haveSequence && (sequence != expectedSequence))statistics.lostFrames += (uint16_t)(sequence - expectedSequence);
+		expectedSequence = (sequence + 1) & 0xFFFF;
+		haveSequence = 1;
+		statistics.frames++;
+		
+		printFrame(frame[2], sequence, timestamp, &frame[FRAME_HEADER_SIZE], length, &statistics);
+		buffer.start += FRAME_OVERHEAD + length;
+	}
+	
+	fprintf(stderr, "%lu frames, %lu samples, %lu lost frames, %lu CRC errors, %lu bad frames\n",
+		statistics.frames, statistics.samples, statistics.lostFrames, statistics.crcErrors, statistics.badFrames);
+	return 0;
+}
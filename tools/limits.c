@@ -0,0 +1,108 @@
+/*********************************************************
+* Output Frequency Limit Table Generator
+* Prints the output frequency limits calculated by the
+* throughput planner for every output mode and baud rate,
+* and checks them against the limits that were measured
+* by hand for the original firmware.
+*
+* Build and run on the host PC with: make limits
+* Returns 1 if a calculated limit is more than 5% away
+* from a measured one that it should match, or more than
+* 5% below one that the new firmware should beat.
+*********************************************************/
+#include <stdio.h>
+#include <stdbool.h>
+#include "SerialAccelerometer.h"
+#include "adc.h"
+#include "throughput.h"
+
+//Must match baudRateSettings in SerialAccelerometer.c
+static const unsigned long baudRates[NUM_BAUD_RATES] = {4800, 9600, 14400, 19200, 38400, 57600, 115200, 250000, 500000, 1000000};
+
+//The hand measured limits from the original firmware for the gravity, raw and binary output modes.
+//Only the first 7 baud rates existed then.
+#define NUM_MEASURED_BAUD_RATES	7
+static const unsigned int measuredLimits[3][NUM_MEASURED_BAUD_RATES] = {
+{25, 45, 66, 83, 125, 142, 166},
+{27, 58, 76, 111, 200, 250, 250},
+{47, 90, 125, 166, 250, 250, 250}
+};
+
+//How each measured limit is checked. Where the original firmware kept the line busy the calculated limit
+//has to be within 5% of the measured one, both ways. Where something else held the original firmware back,
+//the new firmware only has to be no more than 5% slower, and the reason is printed next to the entry.
+#define MEASURED_LINK	0	//The line was the limit, so the calculated limit has to match
+#define MEASURED_CAPPED	1	//The original firmware didn't go above 250 Hz
+#define MEASURED_FORMAT	2	//The floating point formatting of the gravity values was the limit, not the baud rate
+#define MEASURED_WRITES	3	//The original firmware waited for each character to go out before starting the next one,
+						//and sampled and formatted in between, so the line sat idle for part of every frame.
+						//The interrupt driven transmit buffer keeps it busy.
+static const unsigned char measuredReasons[3][NUM_MEASURED_BAUD_RATES] = {
+{MEASURED_LINK, MEASURED_WRITES, MEASURED_WRITES, MEASURED_WRITES, MEASURED_FORMAT, MEASURED_FORMAT, MEASURED_FORMAT},
+{MEASURED_LINK, MEASURED_LINK, MEASURED_WRITES, MEASURED_LINK, MEASURED_WRITES, MEASURED_CAPPED, MEASURED_CAPPED},
+{MEASURED_WRITES, MEASURED_WRITES, MEASURED_WRITES, MEASURED_WRITES, MEASURED_CAPPED, MEASURED_CAPPED, MEASURED_CAPPED}
+};
+static const char* reasonNames[4] = {"", "capped", "formatting", "blocking writes"};
+static const char* modeNames[NUM_OUTPUT_MODES] = {"gravity", "raw", "binary", "framed", "burst", "packed", "delta"};
+
+//Description: Returns the calculated limit for an output mode and baud rate with the default settings
+static unsigned int calculatedLimit(int mode, int baud)
+{
+	//The same conversion rate maxOutputFrequency works out for the default settings: the standard ADC clock
+	//(ADC_MAX_CONVERSION_RATE is what adcConversionRate gives for ADC_CLOCK_STANDARD), the averaging filter,
+	//which adds no main loop work, and no discarded readings
+	unsigned long conversionRate = usableConversionRate(ADC_MAX_CONVERSION_RATE, 0, 0);
+	
+	return throughputLimit(mode, DEFAULT_BURST_SIZE, 3, baudRates[baud], DEFAULT_AVERAGE_SHIFT, conversionRate);
+}
+
+int main(void)
+{
+	unsigned int limit, measured;
+	unsigned char reason;
+	int failures=0;
+	
+	printf("Output frequency limits in Hz (averaging %d samples, bursts of %d samples)\n", 1 << DEFAULT_AVERAGE_SHIFT, DEFAULT_BURST_SIZE);
+	printf("%-8s", "mode");
+	for(int baud=0; baud < NUM_BAUD_RATES; baud++)printf("%14lu", baudRates[baud]);
+	printf("\n");
+	
+	for(int mode=0; mode < NUM_OUTPUT_MODES; mode++){
+		printf("%-8s", modeNames[mode]);
+		for(int baud=0; baud < NUM_BAUD_RATES; baud++){
+			limit = calculatedLimit(mode, baud);
+			if((mode > OUTPUT_BINARY) || (baud >= NUM_MEASURED_BAUD_RATES)){
+				printf("%14u", limit);
+				continue;
+			}
+			//Show the measured limit next to the calculated one
+			measured = measuredLimits[mode][baud];
+			reason = measuredReasons[mode][baud];
+			printf("%8u (%3u)", limit, measured);
+			if(limit * 100 < measured * 95){
+				printf("\n%s at %lu baud: calculated %u Hz is below the measured %u Hz\n", modeNames[mode], baudRates[baud], limit, measured);
+				failures++;
+			}
+			else if((reason == MEASURED_LINK) && (limit * 100 > measured * 105)){
+				printf("\n%s at %lu baud: calculated %u Hz is above the measured %u Hz\n", modeNames[mode], baudRates[baud], limit, measured);
+				failures++;
+			}
+		}
+		printf("\n");
+	}
+	
+	//List the limits that are expected to beat the original firmware, and why
+	printf("\nCalculated limits more than 5%% above the measured ones:\n");
+	for(int mode=0; mode <= OUTPUT_BINARY; mode++){
+		for(int baud=0; baud < NUM_MEASURED_BAUD_RATES; baud++){
+			limit = calculatedLimit(mode, baud);
+			measured = measuredLimits[mode][baud];
+			reason = measuredReasons[mode][baud];
+			if((reason != MEASURED_LINK) && (limit * 100 > measured * 105))
+				printf("%-8s%8lu baud: %4u Hz, measured %3u Hz (%s)\n", modeNames[mode], baudRates[baud], limit, measured, reasonNames[reason]);
+		}
+	}
+	
+	if(failures)printf("%d limits don't agree with the measured values\n", failures);
+	return failures ? 1 : 0;
+}